@@ -9,7 +9,8 @@ cd yaml-cpp-0.5.1
 mkdir build
 cd build
 
-cmake -DBoost_NO_BOOST_CMAKE=TRUE -DYAML_CPP_BUILD_TOOLS=OFF -DYAML_CPP_BUILD_CONTRIB=OFF -DCMAKE_INSTALL_PREFIX:PATH=../../ ..
+# Position independent, so that it can be linked into libplotIt.so
+cmake -DCMAKE_POSITION_INDEPENDENT_CODE=ON -DBoost_NO_BOOST_CMAKE=TRUE -DYAML_CPP_BUILD_TOOLS=OFF -DYAML_CPP_BUILD_CONTRIB=OFF -DCMAKE_INSTALL_PREFIX:PATH=../../ ..
 
 make -j4
 make install
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+class TCanvas;
+class TLegend;
+class TPad;
+class TPaveText;
+class TVirtualPad;
+
+namespace plotIt {
+
+  struct Configuration;
+
+  /**
+   * Canvas, pads and constant decorations for one kind of plot (with or
+   * without a ratio pad). The layout is built once, and only the primitives
+   * of the previous plot are removed before drawing the next one.
+   **/
+  class CanvasLayout {
+    public:
+      CanvasLayout(const Configuration& config, bool ratio);
+
+      // Remove everything drawn by the previous plot, and make the main pad the current one
+      void clear(bool log_y);
+
+      TCanvas& getCanvas() {
+        return *m_canvas;
+      }
+
+      // Pad with the histograms: the canvas itself, or the upper pad with a ratio
+      TVirtualPad& getMainPad();
+
+      // Lower pad, nullptr without a ratio
+      TPad* getRatioPad() {
+        return m_lowPad.get();
+      }
+
+      TLegend& getLegend() {
+        return *m_legend;
+      }
+
+      // Draw the luminosity and experiment labels in the current pad
+      void drawLabels(const std::string& experiment);
+
+      bool hasRatio() const {
+        return m_ratio;
+      }
+
+    private:
+      bool m_ratio;
+
+      // Declared before the pads and decorations, so that it's destroyed after them
+      std::shared_ptr<TCanvas> m_canvas;
+      std::shared_ptr<TPad> m_hiPad;
+      std::shared_ptr<TPad> m_lowPad;
+
+      std::shared_ptr<TLegend> m_legend;
+      std::shared_ptr<TPaveText> m_lumi;
+      std::shared_ptr<TPaveText> m_experiment;
+      std::string m_experimentText;
+  };
+}
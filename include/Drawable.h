@@ -0,0 +1,52 @@
+#pragma once
+
+#include <plotIt.h>
+
+#include <string>
+
+class TH1;
+class TObject;
+
+namespace plotIt {
+
+  /**
+   * Handle on a histogram drawn by a plotter. The extrema of the visible bins
+   * are computed in a single pass and cached.
+   **/
+  class Drawable {
+    public:
+      Drawable(TH1* histogram, const std::string* options);
+
+      TObject* get() const;
+
+      const std::string& getOptions() const {
+        return *m_options;
+      }
+
+      // Compute the extrema of the bins visible with the x axis range of 'plot'
+      void computeExtrema(const Plot& plot);
+
+      float getMinimum() const {
+        return m_minimum;
+      }
+
+      float getMaximum() const {
+        return m_maximum;
+      }
+
+      void setMinimum(float minimum);
+      void setMaximum(float maximum);
+      void setRange(Plot& plot);
+
+      void setDefaultStyle(float topBottomScaleFactor);
+      void setAxisTitles(Plot& plot);
+      void hideXTitle();
+
+    private:
+      TH1* m_histogram;
+      const std::string* m_options;
+
+      float m_minimum;
+      float m_maximum;
+  };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace plotIt {
+
+  /**
+   * Local on-disk cache for input files living on slow or remote storage.
+   * Each input is copied into the cache directory on first access, and the
+   * local copy is used as long as the source size, modification date and
+   * UUID are unchanged. The least recently used entries are evicted when the cache
+   * grows above its maximal size.
+   *
+   * The cache can be shared by several processes. Each process holds a shared
+   * lock on the local copies it uses, which are never evicted while locked.
+   **/
+  class InputCache {
+    public:
+      InputCache(const fs::path& directory, uint64_t maxSize);
+      ~InputCache();
+
+      // Return the path to open for 'path': the local copy if available, 'path' otherwise
+      std::string get(const std::string& path);
+
+      // Path already returned by get() for 'path' during this run, into 'resolved'. False if none
+      bool getResolved(const std::string& path, std::string& resolved) const;
+
+    private:
+      struct Entry {
+        std::string local;
+        uint64_t size;
+        uint32_t modification_date;
+        std::string uuid;
+        uint64_t last_access;
+      };
+
+      void loadIndex();
+      void saveIndex();
+      void evict();
+
+      fs::path m_directory;
+      uint64_t m_maxSize;
+
+      std::map<std::string, Entry> m_entries;
+
+      // Inputs already resolved during this run
+      std::map<std::string, std::string> m_resolved;
+
+      // Lock files of the local copies used by this process, holding a shared lock
+      std::vector<int> m_locks;
+  };
+}
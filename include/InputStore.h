@@ -0,0 +1,76 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TFile;
+class TObject;
+
+namespace fs = boost::filesystem;
+
+namespace plotIt {
+
+  class SnapshotCache;
+
+  /**
+   * Shared access to the input files. Files are opened only once and kept
+   * open, up to MAX_OPEN_FILES: the least recently used ones are closed, and
+   * reopened if needed. Their list of keys is read once, and each object is
+   * read once and kept as a detached copy. A single store can be shared by several plotIt
+   * instances, so that configurations using the same inputs only read them once.
+   * Objects are kept until their file is released.
+   **/
+  class InputStore {
+    public:
+      struct Key {
+        std::string name;
+        std::string class_name;
+      };
+
+      std::shared_ptr<TFile> getFile(const std::string& path);
+
+      // List of the keys of the file, nullptr if the file cannot be opened
+      const std::vector<Key>* getKeys(const std::string& path);
+
+      // Detached copy of the object, owned by the store. nullptr if not found
+      const TObject* getObject(const std::string& path, const std::string& name);
+
+      // Make 'object' available as 'name' in 'path', for objects not read from the file itself
+      void setObject(const std::string& path, const std::string& name, const std::shared_ptr<TObject>& object);
+
+      // Detached object, not kept by the store. For objects needed only once
+      std::shared_ptr<TObject> takeObject(const std::string& path, const std::string& name);
+
+      // Close 'path' and free every object read from it, once no configuration needs it anymore
+      void release(const std::string& path);
+
+      // Read histograms from, and add them to, the snapshots kept in 'directory'
+      void enableSnapshots(const fs::path& directory);
+
+    private:
+      std::shared_ptr<TObject> readObject(const std::string& path, const std::string& name);
+
+      // Well below the usual limit of 1024 file descriptors
+      static const size_t MAX_OPEN_FILES = 256;
+
+      struct OpenFile {
+        std::shared_ptr<TFile> file;
+        uint64_t last_use;
+      };
+
+      // Files which cannot be opened are stored as nullptr, so that they're not opened again
+      std::map<std::string, OpenFile> m_files;
+      uint64_t m_uses = 0;
+      std::map<std::string, std::vector<Key>> m_keys;
+
+      // Missing objects are stored as nullptr, so that they're not looked for again
+      std::map<std::pair<std::string, std::string>, std::shared_ptr<TObject>> m_objects;
+
+      std::shared_ptr<SnapshotCache> m_snapshots;
+  };
+}
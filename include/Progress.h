@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace plotIt {
+
+  /**
+   * Progress of a run: plots done out of the total, throughput, bytes read,
+   * resident memory and estimated time left. The status is refreshed every
+   * second by a background thread, even if no plot finishes, so that a stalled
+   * run is visible. It's shown as a status line on stderr, if stderr is a
+   * terminal, and / or rewritten as a JSON file.
+   **/
+  class Progress {
+    public:
+      Progress(size_t total, bool terminal, const std::string& statusPath);
+      ~Progress();
+
+      // Name of the plot being drawn, or empty
+      void setCurrent(const std::string& name);
+
+      void plotDone(bool success);
+
+      /**
+       * Latest counters of a worker process: bytes read since it was
+       * forked, and its resident memory. They are added to the ones of this process
+       **/
+      void setWorker(size_t worker, uint64_t bytes_read, uint64_t rss);
+
+      // Stop refreshing, and write the final status
+      void finish();
+
+      // Resident memory of this process, in bytes
+      static uint64_t getRSS();
+
+      // Bytes read from ROOT files by this process
+      static uint64_t getBytesRead();
+
+    private:
+      void run();
+      void report(bool final);
+
+      size_t m_total;
+      bool m_terminal;
+      std::string m_statusPath;
+
+      std::chrono::steady_clock::time_point m_start;
+      size_t m_done = 0;
+      size_t m_failed = 0;
+      std::string m_current;
+
+      // Bytes read by this process before the run
+      uint64_t m_initialBytesRead;
+
+      struct WorkerCounters {
+        uint64_t bytes_read = 0;
+        uint64_t rss = 0;
+      };
+      std::vector<WorkerCounters> m_workers;
+
+      std::mutex m_mutex;
+      std::condition_variable m_stop;
+      bool m_finished = false;
+      std::thread m_thread;
+  };
+}
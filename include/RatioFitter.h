@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TF1;
+class TH1;
+
+namespace plotIt {
+
+  /**
+   * Fit of the ratio pad. Functions are compiled once per formula and reused
+   * for every plot. Polynomials ('polN') are fitted with a closed-form weighted
+   * least-squares, which gives the same parameters, errors and confidence band
+   * as the chi-square fit done by Minuit, without any minimization.
+   **/
+  class RatioFitter {
+    public:
+      /**
+       * Fit 'h' in [xMin, xMax] with 'formula', and fill 'errors' with the
+       * confidence band at level 'cl'. The function returned is owned by the
+       * fitter, and is modified by the next fit using the same formula.
+       *
+       * Return nullptr if the formula is invalid
+       **/
+      TF1* fit(TH1* h, const std::string& formula, float xMin, float xMax, TH1* errors, float cl);
+
+    private:
+      struct Function {
+        std::shared_ptr<TF1> function;
+        std::vector<double> initial_parameters;
+
+        // Degree of the polynomial, or -1 if not a polynomial
+        int16_t degree;
+      };
+
+      Function* getFunction(const std::string& formula);
+      bool fitPolynomial(TH1* h, Function& function, float xMin, float xMax, TH1* errors, float cl);
+
+      std::map<std::string, Function> m_functions;
+  };
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class TH1;
+
+namespace plotIt {
+
+  /**
+   * Contents and squared errors of histograms sharing the same binning, packed
+   * into one contiguous samples × cells matrix of doubles. Cells include the
+   * under- and overflows, like TH1::GetNcells. Sums, scaling and stacking work
+   * on whole rows; histograms are only materialized for drawing.
+   **/
+  class SampleMatrix {
+    public:
+      // Pack 'histograms', one row per histogram, using at most 'threads' threads
+      void fill(const std::vector<TH1*>& histograms, uint16_t threads);
+
+      size_t getSamples() const {
+        return m_samples;
+      }
+
+      size_t getCells() const {
+        return m_cells;
+      }
+
+      const double* getContents(size_t sample) const {
+        return m_contents.data() + sample * m_cells;
+      }
+
+      const double* getSumw2(size_t sample) const {
+        return m_sumw2.data() + sample * m_cells;
+      }
+
+      /**
+       * Replace each row by the sum of the rows up to it: row i becomes the
+       * stack of samples 0 to i, and the last row the total. Samples are always
+       * added in the same order, whatever the number of threads.
+       **/
+      void prefixSum(uint16_t threads);
+
+      // Sum of the contents of a row, without under- and overflows, like TH1::GetSumOfWeights
+      double integral(size_t sample) const;
+
+      // Multiply every row by 'factor'
+      void scale(double factor);
+
+      // Copy the row 'sample' into 'h', which must have the binning of the packed histograms
+      void toHistogram(size_t sample, TH1* h) const;
+
+    private:
+      size_t m_samples = 0;
+      size_t m_cells = 0;
+
+      std::vector<double> m_contents;
+      std::vector<double> m_sumw2;
+
+      // 1 for the bins, 0 for the under- and overflows
+      std::vector<double> m_inner;
+  };
+}
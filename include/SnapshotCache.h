@@ -0,0 +1,81 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TFile;
+class TH1;
+class TObject;
+
+namespace fs = boost::filesystem;
+
+namespace plotIt {
+
+  /**
+   * Local cache of the histograms read from the inputs, as raw little-endian
+   * arrays (edges, contents and sumw2) in one memory-mapped file per input.
+   * Snapshots are named after the UUID of the input, entries are keyed by
+   * object name and key cycle, and a snapshot is ignored as soon as the end
+   * of the input moved, ie as soon as anything was written into it.
+   *
+   * Only TH1D and TH1F without bin labels are stored, and they are rebuilt
+   * with their class, binning, contents, errors, statistics, titles, and line,
+   * fill and marker attributes. Other attributes, such as the style of the
+   * axes, come back with their default values: plotIt sets all the ones it
+   * draws with. Histograms read during a run are added to the snapshots when
+   * the cache is destroyed.
+   **/
+  class SnapshotCache {
+    public:
+      SnapshotCache(const fs::path& directory);
+      ~SnapshotCache();
+
+      // True if 'object' can be stored in a snapshot
+      static bool supports(const TObject& object);
+
+      /**
+       * New detached histogram built from the snapshot of 'file', or nullptr
+       * if the snapshot does not contain this cycle of 'name'
+       **/
+      TH1* get(TFile& file, const std::string& name, int16_t cycle);
+
+      // Add 'h', read from 'file', to the snapshot of 'file'
+      void add(TFile& file, const std::string& name, int16_t cycle, const TH1& h);
+
+      // Write the snapshots to which histograms were added
+      void save();
+
+    private:
+      struct Snapshot {
+        fs::path path;
+
+        // End of the input when the snapshot was made
+        uint64_t source_end = 0;
+
+        // Mapped snapshot file, if valid
+        const char* data = nullptr;
+        size_t size = 0;
+
+        // Offset of each record, indexed by 'name;cycle'
+        std::map<std::string, uint64_t> index;
+
+        // Records added during this run, indexed like 'index'
+        std::map<std::string, std::string> added;
+      };
+
+      Snapshot& getSnapshot(TFile& file);
+      void map(Snapshot& snapshot);
+      void unmap(Snapshot& snapshot);
+
+      fs::path m_directory;
+      bool m_enabled;
+
+      // Indexed by UUID of the input
+      std::map<std::string, Snapshot> m_snapshots;
+  };
+}
@@ -1,18 +1,67 @@
 #pragma once
 
+#include <Drawable.h>
+#include <RatioFitter.h>
+#include <SampleMatrix.h>
 #include <plotter.h>
+#include <utilities.h>
 
 namespace plotIt {
+  // Histograms computed for one plot, before drawing
+  struct TH1PreparedPlot: public PreparedPlot {
+    float mcWeight = 0;
+
+    // Layers of the MC stack, from the bottom to the top, with their drawing options.
+    // Each layer is the sum of itself and of all the layers below
+    std::vector<std::pair<std::shared_ptr<TH1>, const std::string*>> mc_layers;
+
+    // Indices of the signal files
+    std::vector<size_t> signal_files;
+
+    std::shared_ptr<TH1> mc_histo_stat_only;
+    std::shared_ptr<TH1> mc_histo_syst_only;
+    std::shared_ptr<TH1> mc_histo_stat_syst;
+
+    std::shared_ptr<TH1> h_data;
+    std::string data_drawing_options;
+
+    // Only computed when the ratio is shown
+    std::shared_ptr<TH1> h_ratio;
+    std::shared_ptr<TH1> h_ratio_systematics;
+  };
+
+  struct TH1PrepareBuffers: public PrepareBuffers {
+    std::vector<TH1*> data_histograms;
+    std::vector<TH1*> mc_histograms;
+    std::vector<std::pair<size_t, size_t>> mc_samples;  // (layer, file index)
+    SampleMatrix mc_matrix;
+    RatioBuffers ratio;
+  };
+
   class TH1Plotter: public plotter {
     public:
       TH1Plotter(plotIt& plotIt):
         plotter(plotIt) {
         }
 
-      virtual bool plot(TCanvas& c, Plot& plot);
+      virtual bool plot(Plot& plot);
       virtual bool supports(TObject& object);
 
+      virtual std::shared_ptr<PreparedPlot> createPreparedPlot();
+      virtual std::shared_ptr<PrepareBuffers> createPrepareBuffers();
+      virtual void prepare(const Plot& plot, PreparedPlot& prepared, PrepareBuffers& buffers, uint16_t threads);
+      virtual bool draw(Plot& plot, PreparedPlot& prepared);
+
     private:
-      void setHistogramStyle(const File& file);
+      void setHistogramStyle(const File& file, TH1* h);
+
+      RatioFitter m_ratio_fitter;
+
+      // Buffers reused from one plot to the other, to avoid allocations
+      TH1PrepareBuffers m_buffers;
+      std::vector<Drawable> m_toDraw;
+      std::string m_options;
+
+      static const std::string s_empty_options;
   };
 }
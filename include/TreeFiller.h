@@ -0,0 +1,49 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TH1;
+
+namespace fs = boost::filesystem;
+
+namespace plotIt {
+
+  /**
+   * Fill histograms from a TTree. All the histograms of a tree are filled in a
+   * single pass: the entries are split into one range per thread, each thread
+   * reads its range through its own handle on the file and fills its own
+   * histograms, which are merged at the end in a fixed order.
+   *
+   * If a cache directory is given, filled histograms are stored there, keyed
+   * by the tree (file UUID, name and number of entries) and the set of histograms.
+   **/
+  class TreeFiller {
+    public:
+      struct Histogram {
+        std::string name;
+        std::string variable;
+        std::string cut;
+
+        // Number of bins, minimum and maximum
+        std::vector<float> binning;
+      };
+
+      TreeFiller(const fs::path& cacheDirectory, uint16_t threads);
+
+      // Fill 'histograms' from the tree 'tree' of 'path'. Return false, after logging the problem, on failure
+      bool fill(const std::string& path, const std::string& tree, const std::vector<Histogram>& histograms, std::map<std::string, std::shared_ptr<TH1>>& result);
+
+    private:
+      fs::path getCachePath(const std::string& uuid, const std::string& tree, int64_t entries, const std::vector<Histogram>& histograms);
+      bool loadFromCache(const fs::path& path, const std::vector<Histogram>& histograms, std::map<std::string, std::shared_ptr<TH1>>& result);
+      void saveToCache(const fs::path& path, const std::map<std::string, std::shared_ptr<TH1>>& result);
+
+      fs::path m_cacheDirectory;
+      uint16_t m_threads;
+  };
+}
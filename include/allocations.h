@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+namespace plotIt {
+  /**
+   * Number of allocations done through the global operator new since startup,
+   * by plotIt and by ROOT. Allocations are only counted if plotIt is built with
+   * 'make COUNT_ALLOCATIONS=1', otherwise this function always returns 0.
+   *
+   * This is a diagnostic only: drawing a plot still allocates, if only because
+   * the input objects are cloned and ROOT creates its own primitives, and
+   * nothing checks the count.
+   **/
+  uint64_t getAllocationsCount();
+
+  bool isAllocationsCountEnabled();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace plotIt {
+
+  enum class LogLevel {
+    ERROR = 0,
+    WARNING,
+    NOTICE, // Final summary, printed even in quiet mode
+    INFO,
+    DEBUG
+  };
+
+  /**
+   * Buffered logger. Text messages are accumulated and written to stdout
+   * by large blocks, instead of being flushed line by line. Warnings and
+   * errors are written to stderr immediately. Messages can optionally be
+   * duplicated into a JSON-lines file. The logger can be used from any thread.
+   **/
+  class Logger {
+    public:
+      static Logger& get();
+
+      ~Logger();
+
+      void setLevel(LogLevel level) {
+        m_level = level;
+      }
+
+      bool isEnabled(LogLevel level) const {
+        return level <= m_level;
+      }
+
+      void setJSONOutput(const std::string& path);
+
+      // Name of the plot currently processed, attached to JSON entries
+      void setContext(const std::string& context) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_context = context;
+      }
+
+      void log(LogLevel level, const std::string& message);
+      void flush();
+
+      /**
+       * Show 'status' as the last line of the terminal, on stderr. Messages are
+       * written above it, and it's redrawn after them. With 'keep', the status
+       * is left as a normal line, and no status is shown anymore
+       **/
+      void setStatus(const std::string& status, bool keep = false);
+
+      /**
+       * Instead of writing them, hand the buffered text, warnings and errors, and JSON
+       * lines to 'forwarder' when flushing. Used by worker processes to send their
+       * logs to the parent.
+       **/
+      void forward(const std::function<void(const std::string& text, const std::string& errors, const std::string& json)>& forwarder) {
+        m_forwarder = forwarder;
+      }
+
+      // Append already formatted text, warnings and errors, and JSON lines, as received from a worker
+      void append(const std::string& text, const std::string& errors, const std::string& json);
+
+    private:
+      Logger();
+
+      void flushLocked();
+
+      std::mutex m_mutex;
+
+      LogLevel m_level = LogLevel::INFO;
+      std::string m_buffer;
+      std::string m_errors;
+      std::string m_json_buffer;
+      std::string m_context;
+      std::string m_status;
+      std::unique_ptr<std::ofstream> m_json;
+      bool m_json_enabled = false;
+      std::function<void(const std::string&, const std::string&, const std::string&)> m_forwarder;
+      std::chrono::steady_clock::time_point m_start;
+  };
+
+  class LogEntry {
+    public:
+      LogEntry(LogLevel level):
+        m_level(level) {
+        }
+
+      ~LogEntry() {
+        Logger::get().log(m_level, m_stream.str());
+      }
+
+      std::ostringstream& stream() {
+        return m_stream;
+      }
+
+    private:
+      LogLevel m_level;
+      std::ostringstream m_stream;
+  };
+
+  // Used to turn the LOG() expression into void, so that it can be used in a ternary operator
+  struct LogVoidify {
+    void operator&(std::ostream&) {}
+  };
+}
+
+/**
+ * Usage: LOG(INFO) << "Plotting '" << name << "'";
+ * The message is not formatted at all if the level is disabled.
+ **/
+#define LOG(level) \
+  !::plotIt::Logger::get().isEnabled(::plotIt::LogLevel::level) ? (void) 0 : \
+  ::plotIt::LogVoidify() & ::plotIt::LogEntry(::plotIt::LogLevel::level).stream()
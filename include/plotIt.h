@@ -4,6 +4,7 @@
 #include <boost/algorithm/string/join.hpp>
 #include <memory>
 #include <iomanip>
+#include <limits>
 
 #include "yaml-cpp/yaml.h"
 
@@ -13,6 +14,7 @@
 
 #include <vector>
 #include <string>
+#include <set>
 #include <glob.h>
 
 #include <defines.h>
@@ -36,7 +38,19 @@ namespace plotIt {
     DATA
   };
 
+  // Comparison of data and MC shown in the ratio pad
+  enum RatioType {
+    RATIO,        // Data / MC
+    PULL,         // (Data - MC) / sigma, with the uncertainties of data and MC
+    SIGNIFICANCE  // Poisson significance of the data, given the MC expectation
+  };
+
   struct PlotStyle;
+  class CanvasLayout;
+  class InputCache;
+  class InputStore;
+  class Progress;
+  class plotter;
   class plotIt;
   struct Group;
 
@@ -57,34 +71,55 @@ namespace plotIt {
   };
 
   struct Systematic {
+    // File containing the variation
     std::string path;
+
+    // Name of the variation, stored in 'syst/<name>/' inside 'path' (the nominal
+    // file, or a file shared by several variations). Empty if the variation has
+    // its own file, with the same layout as the nominal one
+    std::string name;
+
     TObject* object;
 
     Summary summary;
+
+    // Name of 'object' for this variation, inside 'path'
+    std::string getObjectName(const std::string& object) const {
+      if (name.empty())
+        return object;
+
+      return "syst/" + name + "/" + object;
+    }
   };
 
   struct File {
     std::string path;
 
     // For MC and Signal
-    float cross_section;
-    float branching_ratio;
-    float generated_events;
-    float scale;
+    float cross_section = 1;
+    float branching_ratio = 1;
+    float generated_events = 1;
+    float scale = 1;
 
     // For Data
-    float luminosity;
+    float luminosity = 0;
 
     std::shared_ptr<PlotStyle> plot_style;
     std::string group;
 
-    Type type;
+    // Style used for drawing, resolved once the configuration is parsed (either the group style or plot_style)
+    std::shared_ptr<PlotStyle> resolved_plot_style;
 
-    TObject* object;
+    Type type = MC;
+
+    // Tree the histograms are filled from. Empty if the file contains the histograms
+    std::string tree;
+
+    TObject* object = nullptr;
 
     std::vector<Systematic> systematics;
 
-    int16_t order;
+    int16_t order = std::numeric_limits<int16_t>::min();
     Summary summary;
   };
 
@@ -105,6 +140,7 @@ namespace plotIt {
     std::string legend;
     std::string legend_style;
 
+    void loadDefaults(Type type);
     void loadFromYAML(YAML::Node& node, const File& file, plotIt& pIt);
   };
 
@@ -160,11 +196,11 @@ namespace plotIt {
     std::string name;
     std::string exclude;
 
-    bool normalized;
-    bool log_y;
+    bool normalized = false;
+    bool log_y = false;
 
     std::string x_axis;
-    std::string y_axis;
+    std::string y_axis = "Events";
 
     // Axis range
     std::vector<float> x_axis_range;
@@ -172,22 +208,33 @@ namespace plotIt {
 
     std::vector<std::string> save_extensions;
 
-    bool show_ratio;
+    bool show_ratio = false;
+    RatioType ratio_type = RATIO;
     bool fit_ratio = false;
     std::string fit_function = "pol1";
     std::string fit_legend;
     Point fit_legend_position = {0.20, 0.38};
 
-    bool show_errors;
+    bool show_errors = false;
 
-    std::string inherits_from;
+    std::string inherits_from = "TH1";
 
-    uint16_t rebin;
+    uint16_t rebin = 1;
+
+    // For files with a tree: expression filled in the histogram, with an optional
+    // selection, and the binning as [number of bins, minimum, maximum]
+    std::string variable;
+    std::string cut;
+    std::vector<float> binning;
 
     std::vector<Label> labels;
 
     std::string extra_label;
 
+    // Glob patterns on the names of signal files. Matching files are drawn one at a
+    // time over the same background and data, with one output per file
+    std::vector<std::string> signal_scan;
+
     Position legend_position;
 
     void print() {
@@ -211,6 +258,72 @@ namespace plotIt {
     Position position;
   };
 
+  struct FileYield {
+    std::string name;
+    Type type;
+    Summary summary;
+  };
+
+  // Outcome of one plot, written in shard summaries
+  struct PlotResult {
+    std::string name;
+    bool success = false;
+
+    std::vector<std::string> outputs;
+    std::vector<FileYield> yields;
+  };
+
+  // Objects of one file for a given plot
+  struct PreparedFile {
+    TObject* object = nullptr;
+    Summary summary;
+
+    std::vector<TObject*> systematics;
+    std::vector<Summary> systematics_summary;
+  };
+
+  /**
+   * Objects of one plot, kept apart from the files of the configuration so that
+   * several plots can be computed at the same time. Plotters extend it with the
+   * results of their computations
+   **/
+  struct PreparedPlot {
+    virtual ~PreparedPlot() {}
+
+    std::vector<PreparedFile> files;
+
+    // Objects owned by this plot
+    std::vector<std::shared_ptr<TObject>> objects;
+
+    void fromFiles(const std::vector<File>& input) {
+      files.resize(input.size());
+      for (size_t i = 0; i < input.size(); i++) {
+        files[i].object = input[i].object;
+        files[i].summary = input[i].summary;
+
+        files[i].systematics.clear();
+        files[i].systematics_summary.clear();
+        for (const Systematic& syst: input[i].systematics) {
+          files[i].systematics.push_back(syst.object);
+          files[i].systematics_summary.push_back(syst.summary);
+        }
+      }
+    }
+
+    // Make the objects and summaries of this plot the current ones
+    void install(std::vector<File>& output) const {
+      for (size_t i = 0; i < output.size(); i++) {
+        output[i].object = files[i].object;
+        output[i].summary = files[i].summary;
+
+        for (size_t j = 0; j < output[i].systematics.size(); j++) {
+          output[i].systematics[j].object = files[i].systematics[j];
+          output[i].systematics[j].summary = files[i].systematics_summary[j];
+        }
+      }
+    }
+  };
+
   struct Configuration {
     float width;
     float height;
@@ -241,6 +354,43 @@ namespace plotIt {
 
     bool ignore_scales = false;
 
+    // Also compare the binning of every object with the first file, before plotting
+    bool check_binning = false;
+
+    // Number of threads used for computations. With more than one thread, the
+    // computations of the next plots run while the current one is drawn
+    uint16_t threads = 1;
+
+    // Number of worker processes used to draw the plots
+    uint16_t workers = 1;
+
+    // Export computed histograms: "root", "json", or empty to disable
+    std::string export_format;
+
+    // Local cache for the inputs. Disabled if empty
+    std::string input_cache;
+    uint64_t input_cache_size = 0;
+
+    // Cache for the histograms filled from trees. Disabled if empty
+    std::string tree_cache;
+
+    // Binary snapshots of the histograms read from the inputs, reused while the inputs are unchanged. Disabled if empty
+    std::string snapshot_cache;
+
+    // Show the progress of the run as a status line on stderr, and / or write it into this JSON file
+    bool progress = false;
+    std::string progress_file;
+
+    // Root of another production to compare with, instead of plotting. Disabled if empty
+    std::string compare_with;
+
+    // Plots with a chi2 probability below this value, for any file, are drawn
+    float compare_threshold = 0.01;
+
+    // Only draw the plots belonging to this shard
+    uint32_t shard_index = 0;
+    uint32_t shard_count = 1;
+
     Configuration() {
       width = height = 800;
       root = "./";
@@ -254,14 +404,28 @@ namespace plotIt {
 
   class plotIt {
     public:
-      plotIt(const fs::path& outputPath, const std::string& configFile);
-      void plotAll();
+      plotIt(const fs::path& outputPath, const std::string& configFile, const std::string& configCacheDirectory = "");
+
+      // Without configuration file, for use as a library with objects already in memory
+      plotIt(const fs::path& outputPath, const Configuration& config, const std::vector<File>& files, const std::map<std::string, Group>& groups = std::map<std::string, Group>());
+
+      // Return false if the inputs are invalid, or if any plot failed
+      bool plotAll();
+
+      // Draw 'plot' from in-memory objects, one per file
+      TCanvas* plotObjects(Plot& plot, const std::vector<TObject*>& objects);
+
+      // Combine the summaries written by each shard into the final tables
+      bool mergeShards();
+
+      // Compare the inputs with the production in 'compare_with', and only draw the incompatible plots
+      bool compareAll();
 
       std::vector<File>& getFiles() {
         return m_files;
       }
 
-      Configuration getConfiguration() const {
+      const Configuration& getConfiguration() const {
         return m_config;
       }
 
@@ -269,11 +433,36 @@ namespace plotIt {
         return m_config;
       }
 
+      // Share the input files, and the objects read from them, with other instances
+      void setInputStore(const std::shared_ptr<InputStore>& inputs) {
+        m_inputs = inputs;
+      }
+
+      // Paths of the input files, systematics included, as written in the configuration
+      std::set<std::string> getInputFiles() const;
+
+      // Free the inputs of this configuration not in 'needed' from the shared input store
+      void releaseInputs(const std::set<std::string>& needed);
+
       void addTemporaryObject(const std::shared_ptr<TObject>& object) {
         m_temporaryObjects.push_back(object);
       }
 
-      std::shared_ptr<PlotStyle> getPlotStyle(const File& file);
+      void exportObject(const std::string& name, const TObject* object);
+
+      // Name of 'file' unique among the files: its path relative to the root, without extension
+      std::string getSampleName(const File& file) const;
+
+      CanvasLayout& getCanvasLayout(bool ratio);
+
+      const std::shared_ptr<PlotStyle>& getPlotStyle(const File& file) const {
+        return file.resolved_plot_style;
+      }
+
+      // True if the file 'index' is a point of the signal scan of the current plot. Plotters must not draw it
+      bool isScanPoint(size_t index) const {
+        return index < m_scanPoints.size() && m_scanPoints[index];
+      }
 
       friend PlotStyle;
 
@@ -282,22 +471,69 @@ namespace plotIt {
       void parseConfigurationFile(const std::string& file);
       void parseIncludes(YAML::Node& node);
       int16_t loadColor(const YAML::Node& node);
+      int16_t createColor(const std::string& value);
+      void resolvePlotStyles();
+
+      // Cache of the resolved configuration
+      fs::path getConfigurationCachePath(const fs::path& directory, const std::string& configFile);
+      bool loadConfigurationCache(const fs::path& path);
+      void writeConfigurationCache(const fs::path& path);
 
       // Plot method
       bool plot(Plot& plot);
+      bool drawPlot(Plot& plot, plotter* prepared_by = nullptr, PreparedPlot* prepared = nullptr);
 
       bool expandFiles();
       bool expandObjects(File& file, std::vector<Plot>& plots);
       bool loadObject(File& file, const Plot& plot);
+      bool checkInputs(const std::vector<Plot>& plots);
+      std::string getInputPath(const std::string& path);
 
-      void addToLegend(TLegend& legend, Type type);
+      void addToLegend(TLegend& legend, Type type, int64_t scanPoint = -1);
+      void findScanPoints(const Plot& plot);
 
       void parseLumiLabel();
 
       std::vector<Label> mergeLabels(const std::vector<Label>& labels);
 
+      // Worker pool
+      void preloadObjects(const std::vector<Plot>& plots);
+      void createInputStore();
+      TObject* getStoredObject(const std::string& path, const std::string& name, std::vector<std::shared_ptr<TObject>>& owner);
+      uint32_t plotInWorkers(std::vector<Plot>& plots);
+
+      // Pipelined plotting
+      std::shared_ptr<PreparedPlot> loadPreparedPlot(const Plot& plot, std::shared_ptr<plotter>& plotter);
+      uint32_t plotPipelined(std::vector<Plot>& plots);
+
+      // Export of computed histograms
+      fs::path getExportPath(const std::string& name, const std::string& extension);
+      void writeExportedObjects(const Plot& plot);
+      void closeExportFile();
+
+      // Histograms filled from trees
+      bool fillTrees(const std::vector<Plot>& plots);
+
+      // Comparison of productions
+      std::string getComparedPath(const std::string& path);
+
+      // Sharding
+      void selectShard(std::vector<Plot>& plots);
+      void writeShardSummary();
+      std::string getShardRunId();
+
+      void saveCanvas(TCanvas& c, const fs::path& path);
+      void writeOutputsReport();
+
+      // Progress of the run, if enabled
+      void startProgress(size_t total);
+      void reportPlotStarted(const std::string& name);
+      void reportPlotDone(bool success);
+
       fs::path m_outputPath;
 
+      std::vector<std::shared_ptr<plotter>> m_plotters;
+
       std::vector<File> m_files;
       std::vector<Plot> m_plots;
       std::map<std::string, Group> m_groups;
@@ -305,9 +541,41 @@ namespace plotIt {
       // Store objects in order to delete everything when drawing is done
       std::vector<std::shared_ptr<TObject>> m_temporaryObjects;
 
+      // Objects of the last plot drawn, kept until the next one is drawn so that its canvas stays complete
+      std::vector<std::shared_ptr<TObject>> m_lastPlotObjects;
+
+      std::shared_ptr<InputCache> m_inputCache;
+
+      std::vector<std::pair<std::string, std::shared_ptr<TObject>>> m_exportedObjects;
+      std::shared_ptr<TFile> m_exportFile;
+
+      // Index of this process in the worker pool, -1 for the main process
+      int32_t m_workerIndex = -1;
+
+      // Shared access to the inputs. Filled before forking workers, which share
+      // it copy-on-write, or shared with other plotIt instances. When not set,
+      // each plot opens the input files again
+      std::shared_ptr<InputStore> m_inputs;
+
+      // Only set in the main process, during plotAll
+      std::shared_ptr<Progress> m_progress;
+
       // Temporary object living the whole runtime
       std::vector<std::shared_ptr<TObject>> m_temporaryObjectsRuntime;
 
+      // Outputs written (or not) during this run
+      std::vector<fs::path> m_changedOutputs;
+      uint32_t m_unchangedOutputs = 0;
+      std::vector<PlotResult> m_results;
+
+      // Canvases reused by all the plots, with and without ratio
+      std::shared_ptr<CanvasLayout> m_singleLayout;
+      std::shared_ptr<CanvasLayout> m_ratioLayout;
+      CanvasLayout* m_currentLayout = nullptr;
+
+      // Signal files scanned by the current plot
+      std::vector<bool> m_scanPoints;
+
       // Current style
       std::shared_ptr<TStyle> m_style;
 
@@ -318,6 +586,10 @@ namespace plotIt {
 
       // For colors
       uint32_t m_colorIndex = 1000;
+      std::map<std::string, int16_t> m_colors;
+
+      // All the YAML files read to build the configuration
+      std::vector<std::string> m_configurationSources;
   };
 };
 
@@ -335,6 +607,80 @@ inline std::vector<std::string> glob(const std::string& pat) {
 }
 
 namespace YAML {
+  template<>
+    struct convert<plotIt::Type> {
+      static Node encode(const plotIt::Type& rhs) {
+        if (rhs == plotIt::SIGNAL)
+          return Node("signal");
+        else if (rhs == plotIt::DATA)
+          return Node("data");
+
+        return Node("mc");
+      }
+
+      static bool decode(const Node& node, plotIt::Type& rhs) {
+        std::string type = node.as<std::string>();
+        if (type == "signal")
+          rhs = plotIt::SIGNAL;
+        else if (type == "data")
+          rhs = plotIt::DATA;
+        else
+          rhs = plotIt::MC;
+
+        return true;
+      }
+    };
+
+  template<>
+    struct convert<plotIt::PlotResult> {
+      static Node encode(const plotIt::PlotResult& rhs) {
+        Node node;
+        node["name"] = rhs.name;
+        node["success"] = rhs.success;
+        node["outputs"] = rhs.outputs;
+
+        for (const plotIt::FileYield& yield: rhs.yields) {
+          Node y;
+          y["name"] = yield.name;
+          y["type"] = yield.type;
+          y["events"] = yield.summary.n_events;
+          y["events-error"] = yield.summary.n_events_error;
+          y["efficiency"] = yield.summary.efficiency;
+          y["efficiency-error"] = yield.summary.efficiency_error;
+
+          node["yields"].push_back(y);
+        }
+
+        return node;
+      }
+
+      static bool decode(const Node& node, plotIt::PlotResult& rhs) {
+        if (!node.IsMap() || !node["name"])
+          return false;
+
+        rhs.name = node["name"].as<std::string>();
+        rhs.success = node["success"].as<bool>();
+
+        if (node["outputs"])
+          rhs.outputs = node["outputs"].as<std::vector<std::string>>();
+
+        rhs.yields.clear();
+        for (const Node& y: node["yields"]) {
+          plotIt::FileYield yield;
+          yield.name = y["name"].as<std::string>();
+          yield.type = y["type"].as<plotIt::Type>();
+          yield.summary.n_events = y["events"].as<float>();
+          yield.summary.n_events_error = y["events-error"].as<float>();
+          yield.summary.efficiency = y["efficiency"].as<float>();
+          yield.summary.efficiency_error = y["efficiency-error"].as<float>();
+
+          rhs.yields.push_back(yield);
+        }
+
+        return true;
+      }
+    };
+
   template<>
     struct convert<plotIt::Position> {
       static Node encode(const plotIt::Position& rhs) {
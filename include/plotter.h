@@ -2,10 +2,18 @@
 
 #include <plotIt.h>
 
-class TCanvas;
 class TObject;
 
 namespace plotIt {
+
+  /**
+   * Scratch space of 'plotter::prepare', reused from one plot to the next.
+   * Plots prepared at the same time each need their own
+   **/
+  struct PrepareBuffers {
+    virtual ~PrepareBuffers() {}
+  };
+
   class plotter {
 
     public:
@@ -15,9 +23,19 @@ namespace plotIt {
         }
 
 
-      virtual bool plot(TCanvas& c, Plot& plot) = 0;
+      virtual bool plot(Plot& plot) = 0;
       virtual bool supports(TObject& object) = 0;
 
+      // Pipelined plotting. 'prepare' only computes, using the objects of 'prepared',
+      // and may run on any thread. 'draw' runs on the main thread, once the objects
+      // and summaries of 'prepared' are installed in the files. 'prepare' itself uses
+      // up to 'threads' threads: only one when it already runs on a pipeline thread.
+      // Plots are drawn in the canvas layout returned by plotIt::getCanvasLayout
+      virtual std::shared_ptr<PreparedPlot> createPreparedPlot() = 0;
+      virtual std::shared_ptr<PrepareBuffers> createPrepareBuffers() = 0;
+      virtual void prepare(const Plot& plot, PreparedPlot& prepared, PrepareBuffers& buffers, uint16_t threads) = 0;
+      virtual bool draw(Plot& plot, PreparedPlot& prepared) = 0;
+
     protected:
       plotIt& m_plotIt;
 
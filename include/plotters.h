@@ -3,15 +3,14 @@
 #include <TH1Plotter.h>
 
 namespace plotIt {
-  static std::vector<std::shared_ptr<plotter>> s_plotters;
-  void createPlotters(plotIt& plotIt) {
-    s_plotters.push_back(std::make_shared<TH1Plotter>(plotIt));
+  void createPlotters(plotIt& plotIt, std::vector<std::shared_ptr<plotter>>& plotters) {
+    plotters.push_back(std::make_shared<TH1Plotter>(plotIt));
   }
 
-  bool plot(const File& file, TCanvas& c, Plot& plot) {
-    for (auto& plotter: s_plotters) {
+  bool plot(const std::vector<std::shared_ptr<plotter>>& plotters, const File& file, Plot& plot) {
+    for (auto& plotter: plotters) {
       if (plotter->supports(*file.object))
-        return plotter->plot(c, plot);
+        return plotter->plot(plot);
     }
 
     return false;
@@ -4,6 +4,8 @@
 
 #include <plotIt.h>
 
+#include <functional>
+
 namespace plotIt {
   TStyle* createStyle();
 
@@ -25,8 +27,6 @@ namespace plotIt {
         object->GetXaxis()->SetLabelSize(0);
     }
 
-  void setAxisTitles(TObject* object, Plot& plot);
-
   template<class T>
     void setDefaultStyle(T* object, float topBottomScaleFactor) {
 
@@ -47,45 +47,22 @@ namespace plotIt {
       
     }
 
-  void setDefaultStyle(TObject* object, float topBottomScaleFactor);
-
-
   template<class T>
     void hideXTitle(T* object) {
       object->GetXaxis()->SetTitle("");
       object->GetXaxis()->SetTitleSize();
     }
 
-  void hideXTitle(TObject* object);
-
-  template<class T>
-    float getMaximum(T* object) {
-      return object->GetMaximum();
-    }
-
-  float getMaximum(TObject* object);
-
-  template<class T>
-    float getMinimum(T* object) {
-      return object->GetMinimum();
-    }
-
-  float getMinimum(TObject* object);
-
   template<class T>
     void setMaximum(T* object, float minimum) {
       object->SetMaximum(minimum);
     }
 
-  void setMaximum(TObject* object, float minimum);
-
   template<class T>
     void setMinimum(T* object, float minimum) {
       object->SetMinimum(minimum);
     }
 
-  void setMinimum(TObject* object, float minimum);
-
   template<class T>
     void setRange(T* object, Plot& plot) {
       if (plot.x_axis_range.size() == 2)
@@ -96,5 +73,63 @@ namespace plotIt {
       }
     }
 
-  void setRange(TObject* object, Plot& plot);
+  /**
+   * Return true if the output format can be made deterministic, ie if
+   * two identical canvases saved with this format produce the same hash
+   **/
+  bool isDeterministicFormat(const std::string& extension);
+
+  /**
+   * Hash the content of an output file. Volatile metadata (creation
+   * and modification dates) are skipped, so that only the drawing itself is hashed
+   **/
+  std::string getOutputHash(const fs::path& path);
+
+  /**
+   * 64 bits FNV-1a hash. Unlike std::hash, the result is the same
+   * on every platform and for every run
+   **/
+  uint64_t stableHash(const std::string& str);
+
+  // Escape 'str' so that it can be used inside a JSON string
+  std::string escapeJSON(const std::string& str);
+
+  /**
+   * Make ROOT usable from several threads, and return the number of threads
+   * which can actually be used: 'threads' with ROOT 6, and 1 with ROOT 5,
+   * which cannot read files from several threads
+   **/
+  uint16_t enableThreadSafety(uint16_t threads);
+
+  /**
+   * Split [0, n) into contiguous chunks, and call 'f(begin, end)' for each
+   * chunk, using at most 'threads' threads
+   **/
+  void parallelFor(size_t n, uint16_t threads, const std::function<void(size_t, size_t)>& f);
+
+  /**
+   * Sum 'histograms', which must have the same binning, into a new detached
+   * histogram. Bins are summed with a pairwise reduction over contiguous
+   * arrays; the reduction tree does not depend on 'threads', so the result
+   * is bit-for-bit identical whatever the number of threads.
+   **/
+  TH1* sumHistograms(const std::vector<TH1*>& histograms, uint16_t threads);
+
+  // Per-bin arrays of computeRatio, reused from one plot to the other
+  struct RatioBuffers {
+    std::vector<double> d, d_err2, m, m_err2, m_syst;
+    std::vector<double> r, r_err, band, band_err;
+  };
+
+  /**
+   * Compare 'data' to 'mc' in one pass over the bins, and fill 'ratio' and
+   * the band of the MC systematics, 'systematics'. The systematic errors
+   * are the errors of 'mc_syst_only'. Both outputs must have the binning of 'data'.
+   *
+   *  - RATIO: data / mc, band of relative systematics around 1
+   *  - PULL: (data - mc) / sigma, sigma being the data, MC statistical and MC
+   *    systematic errors added in quadrature. Band of systematics / sigma around 0
+   *  - SIGNIFICANCE: signed Poisson significance of data given mc, no band
+   **/
+  void computeRatio(RatioType type, const TH1* data, const TH1* mc, const TH1* mc_syst_only, TH1* ratio, TH1* systematics, RatioBuffers& buffers);
 }
@@ -0,0 +1,112 @@
+#include <CanvasLayout.h>
+
+#include <TCanvas.h>
+#include <TLegend.h>
+#include <TPad.h>
+#include <TPaveText.h>
+
+#include <defines.h>
+#include <plotIt.h>
+
+namespace plotIt {
+
+  CanvasLayout::CanvasLayout(const Configuration& config, bool ratio):
+    m_ratio(ratio) {
+
+    // Canvases are looked up by name by ROOT, and a new canvas replaces any with
+    // the same name: each layout, possibly of another plotIt instance, has its own
+    static uint32_t layouts = 0;
+    std::string name = std::string(ratio ? "canvas_ratio_" : "canvas_") + std::to_string(layouts++);
+    m_canvas = std::make_shared<TCanvas>(name.c_str(), name.c_str(), config.width, config.height);
+
+    float topMargin = TOP_MARGIN;
+    if (ratio) {
+      topMargin /= .6666;
+
+      m_hiPad = std::make_shared<TPad>("pad_hi", "", 0., 0.33333, 1, 1);
+      m_hiPad->SetTopMargin(TOP_MARGIN / .6666);
+      m_hiPad->SetLeftMargin(LEFT_MARGIN);
+      m_hiPad->SetBottomMargin(0.015);
+      m_hiPad->SetRightMargin(RIGHT_MARGIN);
+
+      m_lowPad = std::make_shared<TPad>("pad_lo", "", 0., 0., 1, 0.33333);
+      m_lowPad->SetLeftMargin(LEFT_MARGIN);
+      m_lowPad->SetTopMargin(1.);
+      m_lowPad->SetBottomMargin(BOTTOM_MARGIN / .3333);
+      m_lowPad->SetRightMargin(RIGHT_MARGIN);
+      m_lowPad->SetTickx(1);
+      m_lowPad->SetGridy();
+    }
+
+    // Entries and position are set for each plot
+    m_legend = std::make_shared<TLegend>(0, 0, 1, 1);
+    m_legend->SetTextFont(43);
+    m_legend->SetFillStyle(0);
+    m_legend->SetBorderSize(0);
+
+    // Luminosity label
+    if (config.lumi_label_parsed.length() > 0) {
+      m_lumi = std::make_shared<TPaveText>(LEFT_MARGIN, 1 - 0.5 * topMargin, 1 - RIGHT_MARGIN, 1, "brNDC");
+
+      m_lumi->SetFillStyle(0);
+      m_lumi->SetBorderSize(0);
+      m_lumi->SetMargin(0);
+      m_lumi->SetTextFont(42);
+      m_lumi->SetTextSize(0.6 * topMargin);
+      m_lumi->SetTextAlign(33);
+
+      m_lumi->AddText(config.lumi_label_parsed.c_str());
+    }
+
+    // Experiment, the text depends on the plot
+    m_experiment = std::make_shared<TPaveText>(LEFT_MARGIN, 1 - 0.5 * topMargin, 1 - RIGHT_MARGIN, 1, "brNDC");
+
+    m_experiment->SetFillStyle(0);
+    m_experiment->SetBorderSize(0);
+    m_experiment->SetMargin(0);
+    m_experiment->SetTextFont(62);
+    m_experiment->SetTextSize(0.75 * topMargin);
+    m_experiment->SetTextAlign(13);
+  }
+
+  void CanvasLayout::clear(bool log_y) {
+    // Objects drawn by the previous plot are owned by plotIt, and are not deleted here.
+    // Only objects created by ROOT itself while painting (frames, titles, ...) are.
+    m_canvas->Clear();
+    m_canvas->cd();
+
+    if (m_ratio) {
+      m_hiPad->Clear();
+      m_lowPad->Clear();
+
+      m_hiPad->Draw();
+      m_lowPad->Draw();
+
+      m_hiPad->cd();
+    }
+
+    getMainPad().SetLogy(log_y);
+  }
+
+  TVirtualPad& CanvasLayout::getMainPad() {
+    if (m_ratio)
+      return *m_hiPad;
+
+    return *m_canvas;
+  }
+
+  void CanvasLayout::drawLabels(const std::string& experiment) {
+    if (m_lumi.get())
+      m_lumi->Draw();
+
+    if (experiment.length() > 0) {
+      if (experiment != m_experimentText) {
+        m_experiment->Clear();
+        m_experiment->AddText(experiment.c_str());
+        m_experimentText = experiment;
+      }
+
+      m_experiment->Draw();
+    }
+  }
+}
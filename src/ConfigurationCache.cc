@@ -0,0 +1,465 @@
+#include "plotIt.h"
+
+#include <TColor.h>
+
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#include <boost/format.hpp>
+
+#include <logging.h>
+#include <utilities.h>
+
+/**
+ * Binary cache of the fully resolved configuration (files, groups, plots,
+ * styles and colors). The cache stores the content hash of every YAML file
+ * read while parsing, including the included ones, and is only used if
+ * none of them changed.
+ **/
+
+namespace plotIt {
+
+  // Increase each time the layout of the cache changes
+  static const uint32_t CACHE_VERSION = 5;
+
+  class BinaryWriter {
+    public:
+      BinaryWriter(std::ostream& out):
+        m_out(out) {
+        }
+
+      template<class T>
+        void write(const T& value) {
+          static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only arithmetic types can be written directly");
+          m_out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+      void write(const std::string& value) {
+        write<uint32_t>(value.length());
+        m_out.write(value.data(), value.length());
+      }
+
+      template<class T>
+        void write(const std::vector<T>& values) {
+          write<uint32_t>(values.size());
+          for (const T& value: values)
+            write(value);
+        }
+
+      void write(const Label& label) {
+        write(label.text);
+        write(label.size);
+        write(label.position.x);
+        write(label.position.y);
+      }
+
+      void write(const Position& position) {
+        write(position.x1);
+        write(position.y1);
+        write(position.x2);
+        write(position.y2);
+      }
+
+      void write(const std::shared_ptr<PlotStyle>& style) {
+        write<bool>(style.get() != nullptr);
+        if (! style.get())
+          return;
+
+        write(style->marker_size);
+        write(style->marker_color);
+        write(style->marker_type);
+        write(style->fill_color);
+        write(style->fill_type);
+        write(style->line_width);
+        write(style->line_color);
+        write(style->line_type);
+        write(style->drawing_options);
+        write(style->legend);
+        write(style->legend_style);
+      }
+
+    private:
+      std::ostream& m_out;
+  };
+
+  class BinaryReader {
+    public:
+      BinaryReader(std::istream& in):
+        m_in(in) {
+        }
+
+      template<class T>
+        void read(T& value) {
+          static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only arithmetic types can be read directly");
+          m_in.read(reinterpret_cast<char*>(&value), sizeof(T));
+          check();
+        }
+
+      void read(std::string& value) {
+        uint32_t length;
+        read(length);
+        value.resize(length);
+        m_in.read(&value[0], length);
+        check();
+      }
+
+      template<class T>
+        void read(std::vector<T>& values) {
+          uint32_t size;
+          read(size);
+          values.resize(size);
+          for (T& value: values)
+            read(value);
+        }
+
+      void read(Label& label) {
+        read(label.text);
+        read(label.size);
+        read(label.position.x);
+        read(label.position.y);
+      }
+
+      void read(Position& position) {
+        read(position.x1);
+        read(position.y1);
+        read(position.x2);
+        read(position.y2);
+      }
+
+      void read(std::shared_ptr<PlotStyle>& style) {
+        bool present;
+        read(present);
+        if (! present) {
+          style.reset();
+          return;
+        }
+
+        style = std::make_shared<PlotStyle>();
+        read(style->marker_size);
+        read(style->marker_color);
+        read(style->marker_type);
+        read(style->fill_color);
+        read(style->fill_type);
+        read(style->line_width);
+        read(style->line_color);
+        read(style->line_type);
+        read(style->drawing_options);
+        read(style->legend);
+        read(style->legend_style);
+      }
+
+    private:
+      void check() {
+        if (! m_in.good())
+          throw std::runtime_error("truncated configuration cache");
+      }
+
+      std::istream& m_in;
+  };
+
+  static uint64_t hashFile(const std::string& path) {
+    std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+    if (! f.good())
+      return 0;
+
+    std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    return stableHash(content);
+  }
+
+  /**
+   * Return the path of the cache of 'configFile' inside 'directory', or an
+   * empty path if the directory cannot be created
+   **/
+  fs::path plotIt::getConfigurationCachePath(const fs::path& directory, const std::string& configFile) {
+    boost::system::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+      LOG(WARNING) << "cannot create configuration cache directory " << directory << ": " << error.message();
+      return fs::path();
+    }
+
+    std::string absolute = fs::absolute(configFile).string();
+    return directory / (boost::format("%016x.cache") % stableHash(absolute)).str();
+  }
+
+  bool plotIt::loadConfigurationCache(const fs::path& path) {
+    std::ifstream in(path.string().c_str(), std::ios::in | std::ios::binary);
+    if (! in.good())
+      return false;
+
+    try {
+      BinaryReader reader(in);
+
+      uint32_t version;
+      reader.read(version);
+      if (version != CACHE_VERSION)
+        return false;
+
+      // Sources: the cache is only valid if none of them changed
+      std::vector<std::string> sources;
+      reader.read(sources);
+      for (const std::string& source: sources) {
+        uint64_t hash;
+        reader.read(hash);
+        if (hashFile(source) != hash) {
+          LOG(DEBUG) << "Configuration cache is outdated: '" << source << "' changed";
+          return false;
+        }
+      }
+
+      // Colors, recreated with the same indices
+      uint32_t n_colors;
+      reader.read(n_colors);
+      std::vector<std::pair<int16_t, std::string>> colors(n_colors);
+      for (auto& color: colors) {
+        reader.read(color.first);
+        reader.read(color.second);
+      }
+
+      Configuration config;
+      reader.read(config.width);
+      reader.read(config.height);
+      reader.read(config.luminosity);
+      reader.read(config.scale);
+      reader.read(config.luminosity_error_percent);
+      reader.read(config.error_fill_color);
+      reader.read(config.error_fill_style);
+      reader.read(config.ratio_fit_line_color);
+      reader.read(config.ratio_fit_line_width);
+      reader.read(config.ratio_fit_line_style);
+      reader.read(config.ratio_fit_error_fill_color);
+      reader.read(config.ratio_fit_error_fill_style);
+      reader.read(config.labels);
+      reader.read(config.experiment);
+      reader.read(config.extra_label);
+      reader.read(config.lumi_label);
+      reader.read(config.lumi_label_parsed);
+      reader.read(config.root);
+
+      uint32_t n_groups;
+      reader.read(n_groups);
+      std::map<std::string, Group> groups;
+      for (uint32_t i = 0; i < n_groups; i++) {
+        Group group;
+        reader.read(group.name);
+        reader.read(group.plot_style);
+        group.added = false;
+
+        groups[group.name] = group;
+      }
+
+      uint32_t n_files;
+      reader.read(n_files);
+      std::vector<File> files(n_files);
+      for (File& file: files) {
+        reader.read(file.path);
+        reader.read(file.cross_section);
+        reader.read(file.branching_ratio);
+        reader.read(file.generated_events);
+        reader.read(file.scale);
+        reader.read(file.plot_style);
+        reader.read(file.group);
+        reader.read(file.type);
+        reader.read(file.order);
+        reader.read(file.tree);
+
+        std::vector<std::string> systematics;
+        std::vector<std::string> systematics_names;
+        reader.read(systematics);
+        reader.read(systematics_names);
+        for (size_t i = 0; i < systematics.size(); i++) {
+          Systematic s;
+          s.path = systematics[i];
+          s.name = systematics_names[i];
+          file.systematics.push_back(s);
+        }
+      }
+
+      uint32_t n_plots;
+      reader.read(n_plots);
+      std::vector<Plot> plots(n_plots);
+      for (Plot& plot: plots) {
+        reader.read(plot.name);
+        reader.read(plot.exclude);
+        reader.read(plot.normalized);
+        reader.read(plot.log_y);
+        reader.read(plot.x_axis);
+        reader.read(plot.y_axis);
+        reader.read(plot.x_axis_range);
+        reader.read(plot.y_axis_range);
+        reader.read(plot.save_extensions);
+        reader.read(plot.show_ratio);
+        reader.read(plot.ratio_type);
+        reader.read(plot.fit_ratio);
+        reader.read(plot.fit_function);
+        reader.read(plot.fit_legend);
+        reader.read(plot.fit_legend_position.x);
+        reader.read(plot.fit_legend_position.y);
+        reader.read(plot.show_errors);
+        reader.read(plot.inherits_from);
+        reader.read(plot.rebin);
+        reader.read(plot.variable);
+        reader.read(plot.cut);
+        reader.read(plot.binning);
+        reader.read(plot.labels);
+        reader.read(plot.extra_label);
+        reader.read(plot.signal_scan);
+        reader.read(plot.legend_position);
+      }
+
+      Legend legend;
+      reader.read(legend.position);
+
+      // Everything was read successfully, commit
+      uint32_t nextColorIndex = m_colorIndex;
+      for (const auto& color: colors) {
+        m_colorIndex = color.first;
+        m_colors.erase(color.second);
+        createColor(color.second);
+
+        nextColorIndex = std::max(nextColorIndex, m_colorIndex);
+      }
+      m_colorIndex = nextColorIndex;
+
+      m_configurationSources = sources;
+      m_config = config;
+      m_groups = groups;
+      m_files = files;
+      m_plots = plots;
+      m_legend = legend;
+
+      resolvePlotStyles();
+    } catch (std::exception& e) {
+      LOG(WARNING) << "cannot read configuration cache " << path << ": " << e.what();
+      return false;
+    }
+
+    LOG(DEBUG) << "Configuration loaded from cache " << path;
+
+    return true;
+  }
+
+  void plotIt::writeConfigurationCache(const fs::path& path) {
+    // Write then rename, so that a concurrent run never reads a partial cache.
+    // Runs on the same configuration each write their own temporary file
+    fs::path temporary = path;
+    temporary += ".tmp-" + std::to_string(getpid());
+
+    {
+      std::ofstream out(temporary.string().c_str(), std::ios::out | std::ios::binary);
+      BinaryWriter writer(out);
+
+      writer.write(CACHE_VERSION);
+
+      writer.write(m_configurationSources);
+      for (const std::string& source: m_configurationSources)
+        writer.write(hashFile(source));
+
+      writer.write<uint32_t>(m_colors.size());
+      for (const auto& color: m_colors) {
+        writer.write(color.second);
+        writer.write(color.first);
+      }
+
+      writer.write(m_config.width);
+      writer.write(m_config.height);
+      writer.write(m_config.luminosity);
+      writer.write(m_config.scale);
+      writer.write(m_config.luminosity_error_percent);
+      writer.write(m_config.error_fill_color);
+      writer.write(m_config.error_fill_style);
+      writer.write(m_config.ratio_fit_line_color);
+      writer.write(m_config.ratio_fit_line_width);
+      writer.write(m_config.ratio_fit_line_style);
+      writer.write(m_config.ratio_fit_error_fill_color);
+      writer.write(m_config.ratio_fit_error_fill_style);
+      writer.write(m_config.labels);
+      writer.write(m_config.experiment);
+      writer.write(m_config.extra_label);
+      writer.write(m_config.lumi_label);
+      writer.write(m_config.lumi_label_parsed);
+      writer.write(m_config.root);
+
+      writer.write<uint32_t>(m_groups.size());
+      for (const auto& group: m_groups) {
+        writer.write(group.second.name);
+        writer.write(group.second.plot_style);
+      }
+
+      writer.write<uint32_t>(m_files.size());
+      for (const File& file: m_files) {
+        writer.write(file.path);
+        writer.write(file.cross_section);
+        writer.write(file.branching_ratio);
+        writer.write(file.generated_events);
+        writer.write(file.scale);
+        writer.write(file.plot_style);
+        writer.write(file.group);
+        writer.write(file.type);
+        writer.write(file.order);
+        writer.write(file.tree);
+
+        std::vector<std::string> systematics;
+        std::vector<std::string> systematics_names;
+        for (const Systematic& s: file.systematics) {
+          systematics.push_back(s.path);
+          systematics_names.push_back(s.name);
+        }
+        writer.write(systematics);
+        writer.write(systematics_names);
+      }
+
+      writer.write<uint32_t>(m_plots.size());
+      for (const Plot& plot: m_plots) {
+        writer.write(plot.name);
+        writer.write(plot.exclude);
+        writer.write(plot.normalized);
+        writer.write(plot.log_y);
+        writer.write(plot.x_axis);
+        writer.write(plot.y_axis);
+        writer.write(plot.x_axis_range);
+        writer.write(plot.y_axis_range);
+        writer.write(plot.save_extensions);
+        writer.write(plot.show_ratio);
+        writer.write(plot.ratio_type);
+        writer.write(plot.fit_ratio);
+        writer.write(plot.fit_function);
+        writer.write(plot.fit_legend);
+        writer.write(plot.fit_legend_position.x);
+        writer.write(plot.fit_legend_position.y);
+        writer.write(plot.show_errors);
+        writer.write(plot.inherits_from);
+        writer.write(plot.rebin);
+        writer.write(plot.variable);
+        writer.write(plot.cut);
+        writer.write(plot.binning);
+        writer.write(plot.labels);
+        writer.write(plot.extra_label);
+        writer.write(plot.signal_scan);
+        writer.write(plot.legend_position);
+      }
+
+      writer.write(m_legend.position);
+
+      out.close();
+      if (! out.good()) {
+        LOG(WARNING) << "cannot write configuration cache " << path;
+
+        boost::system::error_code error;
+        fs::remove(temporary, error);
+        return;
+      }
+    }
+
+    boost::system::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+      LOG(WARNING) << "cannot write configuration cache " << path << ": " << error.message();
+      fs::remove(temporary, error);
+    }
+  }
+}
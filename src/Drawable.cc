@@ -0,0 +1,65 @@
+#include <Drawable.h>
+
+#include <TH1.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <utilities.h>
+
+namespace plotIt {
+
+  Drawable::Drawable(TH1* histogram, const std::string* options):
+    m_histogram(histogram), m_options(options) {
+      m_minimum = std::numeric_limits<float>::infinity();
+      m_maximum = std::numeric_limits<float>::lowest();
+    }
+
+  TObject* Drawable::get() const {
+    return m_histogram;
+  }
+
+  void Drawable::computeExtrema(const Plot& plot) {
+    m_minimum = std::numeric_limits<float>::infinity();
+    m_maximum = std::numeric_limits<float>::lowest();
+
+    const TAxis* axis = m_histogram->GetXaxis();
+    int first = 1;
+    int last = axis->GetNbins();
+    if (plot.x_axis_range.size() == 2) {
+      first = std::max(first, axis->FindFixBin(plot.x_axis_range[0]));
+      last = std::min(last, axis->FindFixBin(plot.x_axis_range[1]));
+    }
+
+    for (int i = first; i <= last; i++) {
+      float content = m_histogram->GetBinContent(i);
+
+      m_minimum = std::min(m_minimum, content);
+      m_maximum = std::max(m_maximum, content);
+    }
+  }
+
+  void Drawable::setMinimum(float minimum) {
+    ::plotIt::setMinimum(m_histogram, minimum);
+  }
+
+  void Drawable::setMaximum(float maximum) {
+    ::plotIt::setMaximum(m_histogram, maximum);
+  }
+
+  void Drawable::setRange(Plot& plot) {
+    ::plotIt::setRange(m_histogram, plot);
+  }
+
+  void Drawable::setDefaultStyle(float topBottomScaleFactor) {
+    ::plotIt::setDefaultStyle(m_histogram, topBottomScaleFactor);
+  }
+
+  void Drawable::setAxisTitles(Plot& plot) {
+    ::plotIt::setAxisTitles(m_histogram, plot);
+  }
+
+  void Drawable::hideXTitle() {
+    ::plotIt::hideXTitle(m_histogram);
+  }
+}
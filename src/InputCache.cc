@@ -0,0 +1,253 @@
+#include <InputCache.h>
+
+#include <TFile.h>
+#include <TSystem.h>
+
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <memory>
+
+#include <boost/format.hpp>
+
+#include "yaml-cpp/yaml.h"
+
+#include <logging.h>
+#include <utilities.h>
+
+namespace plotIt {
+
+  // Exclusive lock on the cache directory, shared between all plotIt processes on the node
+  class CacheLock {
+    public:
+      CacheLock(const fs::path& path) {
+        m_fd = open(path.string().c_str(), O_RDWR | O_CREAT, 0644);
+        if (m_fd >= 0)
+          flock(m_fd, LOCK_EX);
+      }
+
+      ~CacheLock() {
+        if (m_fd >= 0) {
+          flock(m_fd, LOCK_UN);
+          close(m_fd);
+        }
+      }
+
+    private:
+      int m_fd;
+  };
+
+  InputCache::InputCache(const fs::path& directory, uint64_t maxSize):
+    m_directory(directory), m_maxSize(maxSize) {
+      fs::create_directories(m_directory);
+    }
+
+  InputCache::~InputCache() {
+    for (int fd: m_locks)
+      close(fd);
+  }
+
+  // Lock file of a local copy. Lock files are never removed, so that all processes lock the same file
+  static fs::path getLockPath(const fs::path& directory, const std::string& local) {
+    return directory / (local + ".lock");
+  }
+
+  void InputCache::loadIndex() {
+    m_entries.clear();
+
+    fs::path index = m_directory / "index.yml";
+    if (! fs::exists(index))
+      return;
+
+    YAML::Node root = YAML::LoadFile(index.string());
+    for (YAML::const_iterator it = root.begin(); it != root.end(); ++it) {
+      const YAML::Node& node = it->second;
+
+      Entry entry;
+      entry.local = node["local"].as<std::string>();
+      entry.size = node["size"].as<uint64_t>();
+      entry.modification_date = node["modification-date"].as<uint32_t>();
+      // Missing from indexes written by older versions: such copies are made again
+      entry.uuid = node["uuid"] ? node["uuid"].as<std::string>() : "";
+      entry.last_access = node["last-access"].as<uint64_t>();
+
+      m_entries[it->first.as<std::string>()] = entry;
+    }
+  }
+
+  void InputCache::saveIndex() {
+    YAML::Node root;
+    for (const auto& it: m_entries) {
+      YAML::Node node;
+      node["local"] = it.second.local;
+      node["size"] = it.second.size;
+      node["modification-date"] = it.second.modification_date;
+      node["uuid"] = it.second.uuid;
+      node["last-access"] = it.second.last_access;
+
+      root[it.first] = node;
+    }
+
+    // Write then rename, so that a crash never leaves a truncated index
+    fs::path index = m_directory / "index.yml";
+    fs::path temporary = m_directory / "index.yml.tmp";
+    {
+      std::ofstream out(temporary.string().c_str());
+      out << root << std::endl;
+    }
+    fs::rename(temporary, index);
+  }
+
+  void InputCache::evict() {
+    uint64_t total = 0;
+    for (const auto& it: m_entries)
+      total += it.second.size;
+
+    while (total > m_maxSize) {
+      // Oldest first
+      std::vector<std::map<std::string, Entry>::iterator> candidates;
+      for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        candidates.push_back(it);
+
+      std::sort(candidates.begin(), candidates.end(), [](const std::map<std::string, Entry>::iterator& a, const std::map<std::string, Entry>::iterator& b) {
+          return a->second.last_access < b->second.last_access;
+        });
+
+      bool evicted = false;
+      for (auto& it: candidates) {
+        // Copies used by any process, including this one, hold a shared lock
+        int fd = open(getLockPath(m_directory, it->second.local).string().c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+          continue;
+
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+          close(fd);
+          continue;
+        }
+
+        LOG(DEBUG) << "Evicting '" << it->first << "' from input cache";
+
+        boost::system::error_code error;
+        fs::remove(m_directory / it->second.local, error);
+        total -= it->second.size;
+        m_entries.erase(it);
+
+        close(fd);
+        evicted = true;
+        break;
+      }
+
+      // Everything left is in use
+      if (! evicted)
+        break;
+    }
+  }
+
+  std::string InputCache::get(const std::string& path) {
+    auto resolved = m_resolved.find(path);
+    if (resolved != m_resolved.end())
+      return resolved->second;
+
+    // Stat the source, which works for remote files too
+    FileStat_t stat;
+    if (gSystem->GetPathInfo(path.c_str(), stat) != 0) {
+      m_resolved[path] = path;
+      return path;
+    }
+
+    // A file regenerated with the same size within the same second has another UUID.
+    // Only the header of the source is read
+    std::string uuid;
+    {
+      std::unique_ptr<TFile> source(TFile::Open(path.c_str()));
+      if (! source.get() || source->IsZombie()) {
+        m_resolved[path] = path;
+        return path;
+      }
+
+      uuid = source->GetUUID().AsString();
+    }
+
+    Entry current;
+    current.local = (boost::format("%016x.root") % stableHash(path)).str();
+    current.size = stat.fSize;
+    current.modification_date = stat.fMtime;
+    current.uuid = uuid;
+    current.last_access = std::time(nullptr);
+
+    fs::path local = m_directory / current.local;
+
+    // Exclusive while the copy is checked or made, so that other processes
+    // wait for it instead of copying the same file
+    int fd = open(getLockPath(m_directory, current.local).string().c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+      LOG(WARNING) << "cannot lock '" << path << "' in input cache, reading it directly";
+      if (fd >= 0)
+        close(fd);
+      m_resolved[path] = path;
+      return path;
+    }
+
+    bool valid;
+    {
+      CacheLock lock(m_directory / "lock");
+      loadIndex();
+
+      auto it = m_entries.find(path);
+      valid = it != m_entries.end() &&
+        it->second.size == current.size &&
+        it->second.modification_date == current.modification_date &&
+        it->second.uuid == current.uuid &&
+        fs::exists(local) && fs::file_size(local) == current.size;
+    }
+
+    // The copy is made without the lock of the whole cache, so that other inputs can be used meanwhile
+    if (! valid) {
+      LOG(INFO) << "Copying '" << path << "' into input cache";
+
+      fs::path temporary = local;
+      temporary += ".tmp-" + std::to_string(getpid());
+      if (! TFile::Cp(path.c_str(), temporary.string().c_str(), false)) {
+        LOG(WARNING) << "cannot copy '" << path << "' into input cache, reading it directly";
+
+        boost::system::error_code error;
+        fs::remove(temporary, error);
+        close(fd);
+        m_resolved[path] = path;
+        return path;
+      }
+
+      fs::rename(temporary, local);
+    }
+
+    // Kept until the end of the run, so that no other process evicts the copy
+    flock(fd, LOCK_SH);
+    m_locks.push_back(fd);
+
+    {
+      CacheLock lock(m_directory / "lock");
+      loadIndex();
+
+      m_entries[path] = current;
+
+      evict();
+      saveIndex();
+    }
+
+    m_resolved[path] = local.string();
+    return local.string();
+  }
+
+  bool InputCache::getResolved(const std::string& path, std::string& resolved) const {
+    auto it = m_resolved.find(path);
+    if (it == m_resolved.end())
+      return false;
+
+    resolved = it->second;
+    return true;
+  }
+}
@@ -0,0 +1,141 @@
+#include <InputStore.h>
+#include <SnapshotCache.h>
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TKey.h>
+#include <TList.h>
+#include <TCollection.h>
+
+namespace plotIt {
+
+  std::shared_ptr<TFile> InputStore::getFile(const std::string& path) {
+    auto it = m_files.find(path);
+    if (it != m_files.end()) {
+      it->second.last_use = ++m_uses;
+      return it->second.file;
+    }
+
+    size_t open = 0;
+    auto oldest = m_files.end();
+    for (auto f = m_files.begin(); f != m_files.end(); ++f) {
+      if (! f->second.file.get())
+        continue;
+
+      open++;
+      if (oldest == m_files.end() || f->second.last_use < oldest->second.last_use)
+        oldest = f;
+    }
+
+    // Closed once no caller holds it anymore
+    if (open >= MAX_OPEN_FILES)
+      m_files.erase(oldest);
+
+    std::shared_ptr<TFile> file(TFile::Open(path.c_str()));
+    if (file.get() && file->IsZombie())
+      file.reset();
+
+    // Also remember files which cannot be opened
+    m_files[path] = {file, ++m_uses};
+
+    return file;
+  }
+
+  const std::vector<InputStore::Key>* InputStore::getKeys(const std::string& path) {
+    auto it = m_keys.find(path);
+    if (it != m_keys.end())
+      return &it->second;
+
+    std::shared_ptr<TFile> file = getFile(path);
+    if (! file.get())
+      return nullptr;
+
+    std::vector<Key>& keys = m_keys[path];
+
+    TIter next(file->GetListOfKeys());
+    TKey* key;
+    while ((key = static_cast<TKey*>(next()))) {
+      keys.push_back({key->GetName(), key->GetClassName()});
+    }
+
+    return &keys;
+  }
+
+  const TObject* InputStore::getObject(const std::string& path, const std::string& name) {
+    auto id = std::make_pair(path, name);
+
+    auto it = m_objects.find(id);
+    if (it != m_objects.end())
+      return it->second.get();
+
+    std::shared_ptr<TObject> copy = readObject(path, name);
+    m_objects[id] = copy;
+
+    return copy.get();
+  }
+
+  void InputStore::setObject(const std::string& path, const std::string& name, const std::shared_ptr<TObject>& object) {
+    m_objects[std::make_pair(path, name)] = object;
+  }
+
+  std::shared_ptr<TObject> InputStore::takeObject(const std::string& path, const std::string& name) {
+    auto it = m_objects.find(std::make_pair(path, name));
+    if (it != m_objects.end()) {
+      std::shared_ptr<TObject> object = it->second;
+      m_objects.erase(it);
+
+      return object;
+    }
+
+    return readObject(path, name);
+  }
+
+  void InputStore::release(const std::string& path) {
+    m_files.erase(path);
+    m_keys.erase(path);
+
+    auto it = m_objects.lower_bound(std::make_pair(path, std::string()));
+    while (it != m_objects.end() && it->first.first == path)
+      it = m_objects.erase(it);
+  }
+
+  void InputStore::enableSnapshots(const fs::path& directory) {
+    if (! m_snapshots.get())
+      m_snapshots = std::make_shared<SnapshotCache>(directory);
+  }
+
+  std::shared_ptr<TObject> InputStore::readObject(const std::string& path, const std::string& name) {
+    std::shared_ptr<TObject> copy;
+
+    std::shared_ptr<TFile> file = getFile(path);
+    if (! file.get())
+      return copy;
+
+    // Snapshots only know the objects at the top of the file
+    TKey* key = nullptr;
+    if (m_snapshots.get() && name.find('/') == std::string::npos) {
+      key = file->GetKey(name.c_str());
+      if (key) {
+        copy.reset(m_snapshots->get(*file, name, key->GetCycle()));
+        if (copy.get())
+          return copy;
+      }
+    }
+
+    TObject* obj = file->Get(name.c_str());
+    if (obj) {
+      copy.reset(obj->Clone());
+      if (TH1* h = dynamic_cast<TH1*>(copy.get())) {
+        h->SetDirectory(nullptr);
+
+        if (key && SnapshotCache::supports(*h))
+          m_snapshots->add(*file, name, key->GetCycle(), *h);
+      }
+
+      // The original is owned by the file, free it now instead of when the file is closed
+      delete obj;
+    }
+
+    return copy;
+  }
+}
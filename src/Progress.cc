@@ -0,0 +1,166 @@
+#include <Progress.h>
+
+#include <TFile.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include <logging.h>
+#include <utilities.h>
+
+namespace fs = boost::filesystem;
+
+namespace plotIt {
+
+  static std::string formatBytes(double bytes) {
+    const char* units[] = {"B", "kB", "MB", "GB", "TB"};
+    size_t unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+      bytes /= 1024;
+      unit++;
+    }
+
+    return (boost::format("%.1f %s") % bytes % units[unit]).str();
+  }
+
+  static std::string formatDuration(double seconds) {
+    uint64_t s = seconds;
+    if (s >= 3600)
+      return (boost::format("%dh%02dm") % (s / 3600) % ((s % 3600) / 60)).str();
+    if (s >= 60)
+      return (boost::format("%dm%02ds") % (s / 60) % (s % 60)).str();
+
+    return (boost::format("%ds") % s).str();
+  }
+
+  Progress::Progress(size_t total, bool terminal, const std::string& statusPath):
+    m_total(total), m_terminal(terminal && isatty(STDERR_FILENO)), m_statusPath(statusPath),
+    m_start(std::chrono::steady_clock::now()), m_initialBytesRead(getBytesRead()) {
+
+      m_thread = std::thread(&Progress::run, this);
+    }
+
+  Progress::~Progress() {
+    finish();
+  }
+
+  uint64_t Progress::getRSS() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (! (statm >> size >> resident))
+      return 0;
+
+    return resident * sysconf(_SC_PAGESIZE);
+  }
+
+  uint64_t Progress::getBytesRead() {
+    return TFile::GetFileBytesRead();
+  }
+
+  void Progress::setCurrent(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current = name;
+  }
+
+  void Progress::plotDone(bool success) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done++;
+    if (! success)
+      m_failed++;
+  }
+
+  void Progress::setWorker(size_t worker, uint64_t bytes_read, uint64_t rss) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_workers.size() <= worker)
+      m_workers.resize(worker + 1);
+
+    m_workers[worker].bytes_read = bytes_read;
+    m_workers[worker].rss = rss;
+  }
+
+  void Progress::finish() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_finished)
+        return;
+
+      m_finished = true;
+    }
+
+    m_stop.notify_all();
+    m_thread.join();
+
+    report(true);
+  }
+
+  void Progress::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (! m_finished) {
+      m_stop.wait_for(lock, std::chrono::seconds(1));
+      if (m_finished)
+        break;
+
+      lock.unlock();
+      report(false);
+      lock.lock();
+    }
+  }
+
+  void Progress::report(bool final) {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    uint64_t bytes_read = getBytesRead() - m_initialBytesRead;
+    uint64_t rss = getRSS();
+
+    size_t done, failed;
+    std::string current;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      done = m_done;
+      failed = m_failed;
+      current = m_current;
+
+      // Memory is summed over processes: pages shared with the workers are counted in each of them
+      for (const WorkerCounters& worker: m_workers) {
+        bytes_read += worker.bytes_read;
+        rss += worker.rss;
+      }
+    }
+
+    double rate = (elapsed > 0) ? done / elapsed : 0;
+    double eta = (rate > 0) ? (m_total - done) / rate : -1;
+
+    if (m_terminal) {
+      double percent = m_total ? 100. * done / m_total : 100;
+      std::string line = (boost::format("[%d/%d] %.1f%%  %.2f plots/s  %s read  RSS %s  ETA %s") % done % m_total % percent % rate % formatBytes(bytes_read) % formatBytes(rss) % ((eta < 0) ? "?" : formatDuration(eta))).str();
+      if (failed)
+        line += (boost::format("  %d failed") % failed).str();
+      if (! final && ! current.empty())
+        line += "  " + current;
+
+      // Through the logger, which writes its messages above the status line
+      Logger::get().setStatus(line, final);
+    }
+
+    if (! m_statusPath.empty()) {
+      // Written aside, then renamed, so that readers never see a partial file
+      fs::path temporaryPath = m_statusPath + ".tmp";
+      {
+        std::ofstream out(temporaryPath.string().c_str());
+        out << "{\"done\": " << done << ", \"failed\": " << failed << ", \"total\": " << m_total
+          << ", \"elapsed\": " << elapsed << ", \"plots_per_second\": " << rate
+          << ", \"bytes_read\": " << bytes_read << ", \"rss\": " << rss
+          << ", \"eta\": " << eta << ", \"current\": \"" << escapeJSON(current) << "\""
+          << ", \"finished\": " << (final ? "true" : "false") << "}" << std::endl;
+      }
+
+      boost::system::error_code error;
+      fs::rename(temporaryPath, m_statusPath, error);
+    }
+  }
+}
@@ -0,0 +1,226 @@
+#include <RatioFitter.h>
+
+#include <TF1.h>
+#include <TH1.h>
+#include <TMath.h>
+#include <TVirtualFitter.h>
+
+#include <cmath>
+
+#include <boost/regex.hpp>
+
+#include <logging.h>
+
+namespace plotIt {
+
+  RatioFitter::Function* RatioFitter::getFunction(const std::string& formula) {
+    auto it = m_functions.find(formula);
+    if (it != m_functions.end())
+      return &it->second;
+
+    // Each function has its own name, since ROOT keeps a global list of functions indexed by name
+    std::string name = "fit_function_" + std::to_string(m_functions.size());
+
+    Function function;
+    function.function = std::make_shared<TF1>(name.c_str(), formula.c_str(), 0, 1);
+    if (function.function->IsZombie()) {
+      LOG(ERROR) << "invalid fit function '" << formula << "'";
+      return nullptr;
+    }
+
+    for (int i = 0; i < function.function->GetNpar(); i++)
+      function.initial_parameters.push_back(function.function->GetParameter(i));
+
+    function.degree = -1;
+    boost::smatch match;
+    static const boost::regex polynomial("\\s*pol([0-9])\\s*");
+    if (boost::regex_match(formula, match, polynomial))
+      function.degree = std::stoi(match[1].str());
+
+    return &m_functions.insert(std::make_pair(formula, function)).first->second;
+  }
+
+  TF1* RatioFitter::fit(TH1* h, const std::string& formula, float xMin, float xMax, TH1* errors, float cl) {
+    Function* function = getFunction(formula);
+    if (! function)
+      return nullptr;
+
+    TF1* fct = function->function.get();
+    fct->SetRange(xMin, xMax);
+    fct->SetParameters(function->initial_parameters.data());
+
+    if (function->degree >= 0 && fitPolynomial(h, *function, xMin, xMax, errors, cl))
+      return fct;
+
+    h->Fit(fct, "MRNEQ");
+    (TVirtualFitter::GetFitter())->GetConfidenceIntervals(errors, cl);
+
+    return fct;
+  }
+
+  /**
+   * Solve the normal equations of the chi-square fit. The model being linear
+   * in its parameters, the chi-square is exactly quadratic: the minimum, the
+   * parabolic and the Minos errors are given by the normal equations.
+   *
+   * Like Minuit, bins are taken at their center, and bins without error are
+   * ignored. Return false if the system is singular, so that Minuit is used instead
+   **/
+  bool RatioFitter::fitPolynomial(TH1* h, Function& function, float xMin, float xMax, TH1* errors, float cl) {
+    const size_t n = function.degree + 1;
+
+    // Powers of x are computed in [-1, 1] for the conditioning of the system
+    const double center = (xMax + xMin) / 2.;
+    const double half_width = (xMax - xMin) / 2.;
+    if (half_width <= 0)
+      return false;
+
+    std::vector<double> matrix(n * n, 0);
+    std::vector<double> vector(n, 0);
+    std::vector<double> powers(n);
+
+    auto computePowers = [&](double x) {
+      double t = (x - center) / half_width;
+      powers[0] = 1;
+      for (size_t k = 1; k < n; k++)
+        powers[k] = powers[k - 1] * t;
+    };
+
+    int points = 0;
+    for (int i = 1; i <= h->GetNbinsX(); i++) {
+      double x = h->GetXaxis()->GetBinCenter(i);
+      double error = h->GetBinError(i);
+      if (x < xMin || x > xMax || error <= 0)
+        continue;
+
+      double w = 1. / (error * error);
+      double y = h->GetBinContent(i);
+
+      computePowers(x);
+      for (size_t j = 0; j < n; j++) {
+        vector[j] += w * powers[j] * y;
+        for (size_t k = 0; k <= j; k++)
+          matrix[j * n + k] += w * powers[j] * powers[k];
+      }
+
+      points++;
+    }
+
+    if (points < (int) n)
+      return false;
+
+    for (size_t j = 0; j < n; j++)
+      for (size_t k = j + 1; k < n; k++)
+        matrix[j * n + k] = matrix[k * n + j];
+
+    // Invert the matrix with a Gauss-Jordan elimination; the inverse is the covariance
+    std::vector<double> covariance(n * n, 0);
+    for (size_t j = 0; j < n; j++)
+      covariance[j * n + j] = 1;
+
+    for (size_t col = 0; col < n; col++) {
+      size_t pivot = col;
+      for (size_t row = col + 1; row < n; row++) {
+        if (std::abs(matrix[row * n + col]) > std::abs(matrix[pivot * n + col]))
+          pivot = row;
+      }
+
+      if (matrix[pivot * n + col] == 0)
+        return false;
+
+      for (size_t k = 0; k < n; k++) {
+        std::swap(matrix[col * n + k], matrix[pivot * n + k]);
+        std::swap(covariance[col * n + k], covariance[pivot * n + k]);
+      }
+
+      double inverse = 1. / matrix[col * n + col];
+      for (size_t k = 0; k < n; k++) {
+        matrix[col * n + k] *= inverse;
+        covariance[col * n + k] *= inverse;
+      }
+
+      for (size_t row = 0; row < n; row++) {
+        if (row == col)
+          continue;
+
+        double factor = matrix[row * n + col];
+        for (size_t k = 0; k < n; k++) {
+          matrix[row * n + k] -= factor * matrix[col * n + k];
+          covariance[row * n + k] -= factor * covariance[col * n + k];
+        }
+      }
+    }
+
+    std::vector<double> scaled(n, 0);
+    for (size_t j = 0; j < n; j++)
+      for (size_t k = 0; k < n; k++)
+        scaled[j] += covariance[j * n + k] * vector[k];
+
+    auto evaluate = [&](double x) {
+      computePowers(x);
+      double value = 0;
+      for (size_t k = 0; k < n; k++)
+        value += scaled[k] * powers[k];
+      return value;
+    };
+
+    double chi2 = 0;
+    for (int i = 1; i <= h->GetNbinsX(); i++) {
+      double x = h->GetXaxis()->GetBinCenter(i);
+      double error = h->GetBinError(i);
+      if (x < xMin || x > xMax || error <= 0)
+        continue;
+
+      double residual = (h->GetBinContent(i) - evaluate(x)) / error;
+      chi2 += residual * residual;
+    }
+
+    // Back to the powers of x: ((x - c) / s)^k = sum_j binomial(k, j) (-c)^(k - j) x^j / s^k
+    std::vector<double> transform(n * n, 0);
+    for (size_t k = 0; k < n; k++) {
+      double binomial = 1;
+      for (size_t j = 0; j <= k; j++) {
+        transform[j * n + k] = binomial * std::pow(-center, k - j) / std::pow(half_width, k);
+        binomial = binomial * (k - j) / (j + 1);
+      }
+    }
+
+    TF1* fct = function.function.get();
+    for (size_t j = 0; j < n; j++) {
+      double parameter = 0;
+      double variance = 0;
+      for (size_t k = 0; k < n; k++) {
+        parameter += transform[j * n + k] * scaled[k];
+        for (size_t l = 0; l < n; l++)
+          variance += transform[j * n + k] * covariance[k * n + l] * transform[j * n + l];
+      }
+
+      fct->SetParameter(j, parameter);
+      fct->SetParError(j, std::sqrt(variance));
+    }
+
+    int ndf = points - n;
+    fct->SetChisquare(chi2);
+    fct->SetNDF(ndf);
+    fct->SetNumberFitPoints(points);
+
+    // Same normalization as TVirtualFitter::GetConfidenceIntervals
+    double factor = (chi2 > 0 && ndf > 0) ?
+      TMath::StudentQuantile(0.5 + cl / 2., ndf) * std::sqrt(chi2 / ndf) :
+      TMath::NormQuantile(0.5 + cl / 2.);
+
+    for (int i = 1; i <= errors->GetNbinsX(); i++) {
+      double value = evaluate(errors->GetXaxis()->GetBinCenter(i));
+
+      double variance = 0;
+      for (size_t j = 0; j < n; j++)
+        for (size_t k = 0; k < n; k++)
+          variance += powers[j] * covariance[j * n + k] * powers[k];
+
+      errors->SetBinContent(i, value);
+      errors->SetBinError(i, std::sqrt(variance) * factor);
+    }
+
+    return true;
+  }
+}
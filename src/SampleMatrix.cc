@@ -0,0 +1,98 @@
+#include <SampleMatrix.h>
+
+#include <TH1.h>
+
+#include <cmath>
+
+#include <utilities.h>
+
+namespace plotIt {
+
+  // Below this number of cells, threads cost more than they save
+  static const size_t MIN_PARALLEL_WORK = 1 << 16;
+
+  void SampleMatrix::fill(const std::vector<TH1*>& histograms, uint16_t threads) {
+    m_samples = histograms.size();
+    m_cells = histograms.empty() ? 0 : histograms[0]->GetNcells();
+
+    // Buffers are only reallocated when the matrix grows
+    m_contents.resize(m_samples * m_cells);
+    m_sumw2.resize(m_samples * m_cells);
+    m_inner.resize(m_cells);
+
+    if (m_samples * m_cells < MIN_PARALLEL_WORK)
+      threads = 1;
+
+    parallelFor(m_samples, threads, [&](size_t begin, size_t end) {
+        for (size_t sample = begin; sample < end; sample++) {
+          TH1* h = histograms[sample];
+          double* contents = m_contents.data() + sample * m_cells;
+          double* sumw2 = m_sumw2.data() + sample * m_cells;
+
+          for (size_t cell = 0; cell < m_cells; cell++) {
+            double error = h->GetBinError(cell);
+            contents[cell] = h->GetBinContent(cell);
+            sumw2[cell] = error * error;
+          }
+        }
+      });
+
+    if (m_samples) {
+      for (size_t cell = 0; cell < m_cells; cell++)
+        m_inner[cell] = (histograms[0]->IsBinUnderflow(cell) || histograms[0]->IsBinOverflow(cell)) ? 0 : 1;
+    }
+  }
+
+  void SampleMatrix::prefixSum(uint16_t threads) {
+    if (m_samples * m_cells < MIN_PARALLEL_WORK)
+      threads = 1;
+
+    // Each thread owns a range of cells, and walks down the samples
+    parallelFor(m_cells, threads, [&](size_t begin, size_t end) {
+        for (size_t sample = 1; sample < m_samples; sample++) {
+          double* contents = m_contents.data() + sample * m_cells;
+          double* sumw2 = m_sumw2.data() + sample * m_cells;
+          const double* previous_contents = contents - m_cells;
+          const double* previous_sumw2 = sumw2 - m_cells;
+
+          for (size_t cell = begin; cell < end; cell++) {
+            contents[cell] += previous_contents[cell];
+            sumw2[cell] += previous_sumw2[cell];
+          }
+        }
+      });
+  }
+
+  double SampleMatrix::integral(size_t sample) const {
+    const double* contents = getContents(sample);
+    const double* inner = m_inner.data();
+
+    double sum = 0;
+    for (size_t cell = 0; cell < m_cells; cell++)
+      sum += contents[cell] * inner[cell];
+
+    return sum;
+  }
+
+  void SampleMatrix::scale(double factor) {
+    double factor2 = factor * factor;
+
+    double* contents = m_contents.data();
+    double* sumw2 = m_sumw2.data();
+    size_t n = m_samples * m_cells;
+    for (size_t i = 0; i < n; i++) {
+      contents[i] *= factor;
+      sumw2[i] *= factor2;
+    }
+  }
+
+  void SampleMatrix::toHistogram(size_t sample, TH1* h) const {
+    const double* contents = getContents(sample);
+    const double* sumw2 = getSumw2(sample);
+
+    for (size_t cell = 0; cell < m_cells; cell++) {
+      h->SetBinContent(cell, contents[cell]);
+      h->SetBinError(cell, std::sqrt(sumw2[cell]));
+    }
+  }
+}
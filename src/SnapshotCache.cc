@@ -0,0 +1,400 @@
+#include <SnapshotCache.h>
+
+#include <TFile.h>
+#include <TH1.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+
+#include <logging.h>
+
+namespace plotIt {
+
+  static const uint32_t SNAPSHOT_MAGIC = 0x50534E50; // 'PNSP' in little-endian
+  static const uint32_t SNAPSHOT_VERSION = 2;
+
+  // All the structures and arrays of a snapshot are aligned on 8 bytes
+  struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_end;
+    uint64_t index_offset;
+    uint64_t entries;
+  };
+
+  enum RecordFlags: uint32_t {
+    VARIABLE_BINNING = 1,
+    HAS_SUMW2 = 2
+  };
+
+  // Class of the histogram, rebuilt as such
+  enum RecordType: uint32_t {
+    TYPE_TH1D = 0,
+    TYPE_TH1F = 1
+  };
+
+  struct RecordHeader {
+    // Size of the whole record, arrays included
+    uint64_t size;
+    uint32_t title_length;
+    int32_t nbins;
+    uint32_t flags;
+    uint32_t type;
+    uint32_t x_title_length;
+    uint32_t y_title_length;
+
+    // Line color, style and width, fill color and style, marker color and style
+    int32_t attributes[8];
+    double marker_size;
+
+    double xmin;
+    double xmax;
+    double entries;
+    double stats[4];
+
+    // Followed by the title, the axis titles, the edges if VARIABLE_BINNING,
+    // the contents and the sumw2 if HAS_SUMW2, with under- and overflows
+  };
+
+  static size_t align(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+  }
+
+  static void append(std::string& buffer, const void* data, size_t length) {
+    buffer.append(static_cast<const char*>(data), length);
+    buffer.append(align(length) - length, '\0');
+  }
+
+  static bool isLittleEndian() {
+    uint16_t value = 1;
+    return *reinterpret_cast<uint8_t*>(&value) == 1;
+  }
+
+  SnapshotCache::SnapshotCache(const fs::path& directory):
+    m_directory(directory), m_enabled(isLittleEndian()) {
+
+      if (! m_enabled) {
+        LOG(WARNING) << "the snapshot cache is only supported on little-endian hosts, it's disabled";
+        return;
+      }
+
+      boost::system::error_code error;
+      fs::create_directories(m_directory, error);
+    }
+
+  SnapshotCache::~SnapshotCache() {
+    save();
+
+    for (auto& snapshot: m_snapshots)
+      unmap(snapshot.second);
+  }
+
+  bool SnapshotCache::supports(const TObject& object) {
+    std::string type = object.ClassName();
+    if (type != "TH1D" && type != "TH1F")
+      return false;
+
+    return ! static_cast<const TH1&>(object).GetXaxis()->GetLabels();
+  }
+
+  /**
+   * Build a histogram of class T from a record. 'p' points to the edges if
+   * the binning is variable, or to the contents otherwise
+   **/
+  template <class T>
+  static T* buildHistogram(const std::string& name, const std::string& title, const RecordHeader& header, const char* p) {
+    T* h;
+    if (header.flags & VARIABLE_BINNING) {
+      h = new T(name.c_str(), title.c_str(), header.nbins, reinterpret_cast<const double*>(p));
+      p += (header.nbins + 1) * sizeof(double);
+    } else {
+      h = new T(name.c_str(), title.c_str(), header.nbins, header.xmin, header.xmax);
+    }
+    h->SetDirectory(nullptr);
+
+    // Straight copies from the mapped pages for TH1D, conversions for TH1F
+    size_t n_cells = header.nbins + 2;
+    const double* contents = reinterpret_cast<const double*>(p);
+    std::copy(contents, contents + n_cells, h->GetArray());
+    p += n_cells * sizeof(double);
+
+    if (header.flags & HAS_SUMW2) {
+      h->Sumw2();
+      memcpy(h->GetSumw2()->GetArray(), p, n_cells * sizeof(double));
+    }
+
+    return h;
+  }
+
+  void SnapshotCache::map(Snapshot& snapshot) {
+    int fd = open(snapshot.path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SnapshotHeader)) {
+      close(fd);
+      return;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+      return;
+
+    snapshot.data = static_cast<const char*>(data);
+    snapshot.size = st.st_size;
+
+    SnapshotHeader header;
+    memcpy(&header, snapshot.data, sizeof(header));
+    if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.source_end != snapshot.source_end || header.index_offset > snapshot.size) {
+      // Another version, or the input changed since: the snapshot is rebuilt
+      unmap(snapshot);
+      return;
+    }
+
+    const char* p = snapshot.data + header.index_offset;
+    const char* end = snapshot.data + snapshot.size;
+    for (uint64_t i = 0; i < header.entries; i++) {
+      uint32_t key_length;
+      uint64_t offset;
+      if (p + 16 > end)
+        break;
+
+      memcpy(&key_length, p, sizeof(key_length));
+      memcpy(&offset, p + 8, sizeof(offset));
+      p += 16;
+
+      if (p + key_length > end || offset + sizeof(RecordHeader) > header.index_offset)
+        break;
+
+      snapshot.index[std::string(p, key_length)] = offset;
+      p += align(key_length);
+    }
+  }
+
+  void SnapshotCache::unmap(Snapshot& snapshot) {
+    if (snapshot.data)
+      munmap(const_cast<char*>(snapshot.data), snapshot.size);
+
+    snapshot.data = nullptr;
+    snapshot.size = 0;
+    snapshot.index.clear();
+  }
+
+  SnapshotCache::Snapshot& SnapshotCache::getSnapshot(TFile& file) {
+    std::string uuid = file.GetUUID().AsString();
+
+    auto it = m_snapshots.find(uuid);
+    if (it != m_snapshots.end())
+      return it->second;
+
+    Snapshot& snapshot = m_snapshots[uuid];
+    snapshot.path = m_directory / (uuid + ".snapshot");
+    snapshot.source_end = file.GetEND();
+    map(snapshot);
+
+    return snapshot;
+  }
+
+  TH1* SnapshotCache::get(TFile& file, const std::string& name, int16_t cycle) {
+    if (! m_enabled)
+      return nullptr;
+
+    Snapshot& snapshot = getSnapshot(file);
+
+    auto it = snapshot.index.find(name + ";" + std::to_string(cycle));
+    if (it == snapshot.index.end())
+      return nullptr;
+
+    const char* record = snapshot.data + it->second;
+    RecordHeader header;
+    memcpy(&header, record, sizeof(header));
+
+    size_t n_cells = header.nbins + 2;
+    size_t expected = sizeof(header) + align(header.title_length) + align(header.x_title_length) + align(header.y_title_length) + n_cells * sizeof(double) *
+      (1 + ((header.flags & HAS_SUMW2) ? 1 : 0)) + ((header.flags & VARIABLE_BINNING) ? (header.nbins + 1) * sizeof(double) : 0);
+    if (header.nbins <= 0 || header.type > TYPE_TH1F || header.size != expected || it->second + header.size > snapshot.size)
+      return nullptr;
+
+    const char* p = record + sizeof(header);
+    std::string title(p, header.title_length);
+    p += align(header.title_length);
+    std::string x_title(p, header.x_title_length);
+    p += align(header.x_title_length);
+    std::string y_title(p, header.y_title_length);
+    p += align(header.y_title_length);
+
+    TH1* h;
+    if (header.type == TYPE_TH1F)
+      h = buildHistogram<TH1F>(name, title, header, p);
+    else
+      h = buildHistogram<TH1D>(name, title, header, p);
+
+    h->GetXaxis()->SetTitle(x_title.c_str());
+    h->GetYaxis()->SetTitle(y_title.c_str());
+
+    h->SetLineColor(header.attributes[0]);
+    h->SetLineStyle(header.attributes[1]);
+    h->SetLineWidth(header.attributes[2]);
+    h->SetFillColor(header.attributes[3]);
+    h->SetFillStyle(header.attributes[4]);
+    h->SetMarkerColor(header.attributes[5]);
+    h->SetMarkerStyle(header.attributes[6]);
+    h->SetMarkerSize(header.marker_size);
+
+    double stats[4];
+    memcpy(stats, header.stats, sizeof(stats));
+    h->PutStats(stats);
+    h->SetEntries(header.entries);
+
+    return h;
+  }
+
+  void SnapshotCache::add(TFile& file, const std::string& name, int16_t cycle, const TH1& h) {
+    if (! m_enabled || ! supports(h))
+      return;
+
+    Snapshot& snapshot = getSnapshot(file);
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+
+    const TAxis* axis = h.GetXaxis();
+    std::string title = h.GetTitle();
+    std::string x_title = axis->GetTitle();
+    std::string y_title = h.GetYaxis()->GetTitle();
+    header.type = (std::string(h.ClassName()) == "TH1F") ? TYPE_TH1F : TYPE_TH1D;
+    header.title_length = title.length();
+    header.x_title_length = x_title.length();
+    header.y_title_length = y_title.length();
+    header.nbins = h.GetNbinsX();
+    header.xmin = axis->GetXmin();
+    header.xmax = axis->GetXmax();
+    header.entries = h.GetEntries();
+    h.GetStats(header.stats);
+
+    header.attributes[0] = h.GetLineColor();
+    header.attributes[1] = h.GetLineStyle();
+    header.attributes[2] = h.GetLineWidth();
+    header.attributes[3] = h.GetFillColor();
+    header.attributes[4] = h.GetFillStyle();
+    header.attributes[5] = h.GetMarkerColor();
+    header.attributes[6] = h.GetMarkerStyle();
+    header.marker_size = h.GetMarkerSize();
+
+    bool variable = axis->GetXbins()->GetSize() > 0;
+    bool sumw2 = h.GetSumw2N() > 0;
+    if (variable)
+      header.flags |= VARIABLE_BINNING;
+    if (sumw2)
+      header.flags |= HAS_SUMW2;
+
+    size_t n_cells = header.nbins + 2;
+    std::vector<double> contents(n_cells);
+    std::vector<double> errors2(sumw2 ? n_cells : 0);
+    for (size_t cell = 0; cell < n_cells; cell++) {
+      contents[cell] = h.GetBinContent(cell);
+      if (sumw2)
+        errors2[cell] = h.GetSumw2()->GetAt(cell);
+    }
+
+    std::string record;
+    record.reserve(sizeof(header) + align(title.length()) + (n_cells * 3 + 1) * sizeof(double));
+    record.append(sizeof(header), '\0');
+    append(record, title.data(), title.length());
+    append(record, x_title.data(), x_title.length());
+    append(record, y_title.data(), y_title.length());
+    if (variable)
+      append(record, axis->GetXbins()->GetArray(), (header.nbins + 1) * sizeof(double));
+    append(record, contents.data(), contents.size() * sizeof(double));
+    if (sumw2)
+      append(record, errors2.data(), errors2.size() * sizeof(double));
+
+    header.size = record.size();
+    memcpy(&record[0], &header, sizeof(header));
+
+    snapshot.added[name + ";" + std::to_string(cycle)] = record;
+  }
+
+  /**
+   * Rewrite each snapshot with new records: the records already mapped are
+   * copied, the new ones appended, and the index written at the end. Snapshots
+   * are written aside, then renamed, so that other processes never read a partial file
+   **/
+  void SnapshotCache::save() {
+    for (auto& it: m_snapshots) {
+      Snapshot& snapshot = it.second;
+      if (snapshot.added.empty())
+        continue;
+
+      std::string index;
+      uint64_t entries = 0;
+      uint64_t offset = sizeof(SnapshotHeader);
+
+      fs::path temporaryPath = snapshot.path;
+      temporaryPath += ".tmp-" + std::to_string(getpid());
+      std::ofstream out(temporaryPath.string().c_str(), std::ios::binary);
+      if (! out) {
+        LOG(WARNING) << "cannot write " << snapshot.path << " into the snapshot cache";
+        continue;
+      }
+
+      SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, snapshot.source_end, 0, 0};
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+      auto write = [&](const std::string& key, const char* record, uint64_t size) {
+        uint32_t key_length = key.length();
+        uint32_t padding = 0;
+        index.append(reinterpret_cast<const char*>(&key_length), sizeof(key_length));
+        index.append(reinterpret_cast<const char*>(&padding), sizeof(padding));
+        index.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+        append(index, key.data(), key.length());
+
+        out.write(record, size);
+        offset += size;
+        entries++;
+      };
+
+      for (auto& entry: snapshot.index) {
+        if (snapshot.added.count(entry.first))
+          continue;
+
+        RecordHeader record;
+        memcpy(&record, snapshot.data + entry.second, sizeof(record));
+        if (entry.second + record.size <= snapshot.size)
+          write(entry.first, snapshot.data + entry.second, record.size);
+      }
+
+      for (auto& entry: snapshot.added)
+        write(entry.first, entry.second.data(), entry.second.size());
+
+      out.write(index.data(), index.size());
+
+      header.index_offset = offset;
+      header.entries = entries;
+      out.seekp(0);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.close();
+
+      // A short write, eg. on a full disk, must not replace a good snapshot
+      boost::system::error_code error;
+      if (! out.good()) {
+        LOG(WARNING) << "cannot write " << snapshot.path << " into the snapshot cache";
+        fs::remove(temporaryPath, error);
+        continue;
+      }
+
+      fs::rename(temporaryPath, snapshot.path, error);
+      if (error)
+        fs::remove(temporaryPath, error);
+
+      snapshot.added.clear();
+    }
+  }
+}
@@ -1,125 +1,221 @@
 #include <TH1Plotter.h>
 
-#include <TCanvas.h>
 #include <TF1.h>
 #include <TLatex.h>
 #include <TObject.h>
-#include <TVirtualFitter.h>
+#include <TPad.h>
+#include <TVirtualPad.h>
+
+#include <algorithm>
+#include <map>
 
 #include <boost/format.hpp>
+#include <CanvasLayout.h>
+#include <Drawable.h>
+#include <logging.h>
 #include <utilities.h>
 
 namespace plotIt {
 
+  const std::string TH1Plotter::s_empty_options;
+
   bool TH1Plotter::supports(TObject& object) {
     return object.InheritsFrom("TH1");
   }
 
-  bool TH1Plotter::plot(TCanvas& c, Plot& plot) {
-    c.cd();
+  std::shared_ptr<PreparedPlot> TH1Plotter::createPreparedPlot() {
+    return std::make_shared<TH1PreparedPlot>();
+  }
+
+  std::shared_ptr<PrepareBuffers> TH1Plotter::createPrepareBuffers() {
+    return std::make_shared<TH1PrepareBuffers>();
+  }
+
+  bool TH1Plotter::plot(Plot& plot) {
+    TH1PreparedPlot prepared;
+    prepared.fromFiles(m_plotIt.getFiles());
+
+    prepare(plot, prepared, m_buffers, m_plotIt.getConfiguration().threads);
+    prepared.install(m_plotIt.getFiles());
+
+    return draw(plot, prepared);
+  }
+
+  /**
+   * Scale, style and sum the histograms of 'plot'. Only the objects of 'prepared'
+   * are modified, so that several plots can be prepared at the same time
+   **/
+  void TH1Plotter::prepare(const Plot& plot, PreparedPlot& p, PrepareBuffers& b, uint16_t threads) {
+    TH1PreparedPlot& prepared = static_cast<TH1PreparedPlot&>(p);
+    TH1PrepareBuffers& buffers = static_cast<TH1PrepareBuffers&>(b);
+
+    const Configuration& config = m_plotIt.getConfiguration();
+    const std::vector<File>& files = m_plotIt.getFiles();
+
+    std::vector<TH1*>& data_histograms = buffers.data_histograms;
+    std::vector<TH1*>& mc_histograms = buffers.mc_histograms;
+    std::vector<std::pair<size_t, size_t>>& mc_samples = buffers.mc_samples;
+    SampleMatrix& mc_matrix = buffers.mc_matrix;
 
     // Rescale and style histograms
-    for (File& file: m_plotIt.getFiles()) {
-      setHistogramStyle(file);
+    for (size_t i = 0; i < files.size(); i++) {
+      const File& file = files[i];
+      PreparedFile& prepared_file = prepared.files[i];
+      Summary& summary = prepared_file.summary;
 
-      TH1* h = dynamic_cast<TH1*>(file.object);
+      TH1* h = dynamic_cast<TH1*>(prepared_file.object);
+      setHistogramStyle(file, h);
 
       if (file.type != DATA) {
-        float factor = m_plotIt.getConfiguration().luminosity * file.cross_section * file.branching_ratio / file.generated_events;
-        if (! m_plotIt.getConfiguration().ignore_scales) {
-          factor *= m_plotIt.getConfiguration().scale * file.scale;
+        float factor = config.luminosity * file.cross_section * file.branching_ratio / file.generated_events;
+        if (! config.ignore_scales) {
+          factor *= config.scale * file.scale;
         }
 
         float n_entries = h->Integral();
-        file.summary.efficiency = n_entries / file.generated_events;
-        file.summary.efficiency_error = sqrt( (file.summary.efficiency * (1 - file.summary.efficiency)) / file.generated_events );
+        summary.efficiency = n_entries / file.generated_events;
+        summary.efficiency_error = sqrt( (summary.efficiency * (1 - summary.efficiency)) / file.generated_events );
 
-        file.summary.n_events = n_entries * factor;
-        file.summary.n_events_error = m_plotIt.getConfiguration().luminosity * file.cross_section * file.branching_ratio * file.summary.efficiency_error;
-        if (! m_plotIt.getConfiguration().ignore_scales) {
-          file.summary.n_events_error *= m_plotIt.getConfiguration().scale * file.scale;
+        summary.n_events = n_entries * factor;
+        summary.n_events_error = config.luminosity * file.cross_section * file.branching_ratio * summary.efficiency_error;
+        if (! config.ignore_scales) {
+          summary.n_events_error *= config.scale * file.scale;
         }
 
         h->Scale(factor);
       } else {
-        file.summary.n_events = h->Integral();
-        file.summary.n_events_error = 0;
+        summary.n_events = h->Integral();
+        summary.n_events_error = 0;
       }
 
       h->Rebin(plot.rebin);
 
-      for (Systematic& s: file.systematics) {
-        TH1* syst = static_cast<TH1*>(s.object);
+      for (TObject* s: prepared_file.systematics) {
+        TH1* syst = static_cast<TH1*>(s);
         syst->Rebin(plot.rebin);
       }
     }
 
-    // Build a THStack for MC files and a vector for signal
-    float mcWeight = 0;
-    std::shared_ptr<THStack> mc_stack;
-    std::shared_ptr<TH1> mc_histo_stat_only;
-    std::shared_ptr<TH1> mc_histo_syst_only;
-    std::shared_ptr<TH1> mc_histo_stat_syst;
+    // Collect the MC samples, and the signal files
+    prepared.mcWeight = 0;
+    prepared.mc_layers.clear();
+    prepared.signal_files.clear();
+    prepared.data_drawing_options.clear();
+
+    data_histograms.clear();
+    mc_histograms.clear();
+    mc_samples.clear();
 
-    std::shared_ptr<TH1> h_data;
-    std::string data_drawing_options;
+    // The files of a group form one layer of the stack, at the position of the first file of the group
+    std::map<std::string, size_t> group_layers;
+    size_t n_layers = 0;
 
-    std::vector<File> signal_files;
+    for (size_t i = 0; i < files.size(); i++) {
+      const File& file = files[i];
 
-    for (File& file: m_plotIt.getFiles()) {
       if (file.type == MC) {
+        size_t layer = n_layers;
+        if (! file.group.empty()) {
+          auto it = group_layers.insert(std::make_pair(file.group, n_layers)).first;
+          layer = it->second;
+        }
 
-        TH1* nominal = dynamic_cast<TH1*>(file.object);
+        if (layer == n_layers)
+          n_layers++;
 
-        if (mc_stack.get() == nullptr)
-          mc_stack = std::make_shared<THStack>("mc_stack", "mc_stack");
-
-        mc_stack->Add(nominal, m_plotIt.getPlotStyle(file)->drawing_options.c_str());
-        if (mc_histo_stat_only.get()) {
-          mc_histo_stat_only->Add(nominal);
-        } else {
-          mc_histo_stat_only.reset( dynamic_cast<TH1*>(nominal->Clone()) );
-          mc_histo_stat_only->SetDirectory(nullptr);
-        }
-        mcWeight += nominal->GetSumOfWeights();
+        mc_samples.push_back(std::make_pair(layer, i));
 
       } else if (file.type == SIGNAL) {
-        signal_files.push_back(file);
+        prepared.signal_files.push_back(i);
       } else if (file.type == DATA) {
-        if (! h_data.get()) {
-          h_data.reset(dynamic_cast<TH1*>(file.object->Clone()));
-          h_data->SetDirectory(nullptr);
-          data_drawing_options += m_plotIt.getPlotStyle(file)->drawing_options;
-        } else {
-          h_data->Add(dynamic_cast<TH1*>(file.object));
-        }
+        if (data_histograms.empty())
+          prepared.data_drawing_options += m_plotIt.getPlotStyle(file)->drawing_options;
+
+        data_histograms.push_back(dynamic_cast<TH1*>(prepared.files[i].object));
       }
     }
 
+    // Samples of the same layer are consecutive rows of the matrix
+    std::stable_sort(mc_samples.begin(), mc_samples.end(), [](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+        return a.first < b.first;
+      });
+
+    for (auto& sample: mc_samples)
+      mc_histograms.push_back(dynamic_cast<TH1*>(prepared.files[sample.second].object));
+
+    std::shared_ptr<TH1>& mc_histo_stat_only = prepared.mc_histo_stat_only;
+    std::shared_ptr<TH1>& mc_histo_syst_only = prepared.mc_histo_syst_only;
+    std::shared_ptr<TH1>& mc_histo_stat_syst = prepared.mc_histo_stat_syst;
+    std::shared_ptr<TH1>& h_data = prepared.h_data;
+
+    // Sum data
+    if (! data_histograms.empty())
+      h_data.reset(sumHistograms(data_histograms, threads));
+
     if ((h_data.get()) && !h_data->GetSumOfWeights())
       h_data.reset();
 
-    if ((mc_histo_stat_only.get() && !mc_histo_stat_only->GetSumOfWeights())) {
-      mc_histo_stat_only.reset();
-      mc_stack.reset();
+    // Stack MC: after the prefix sum, the last row of each layer is the top of the layer,
+    // and the last row of the matrix the total
+    mc_histo_stat_only.reset();
+    if (! mc_histograms.empty()) {
+      mc_matrix.fill(mc_histograms, threads);
+      mc_matrix.prefixSum(threads);
+
+      size_t total = mc_matrix.getSamples() - 1;
+      prepared.mcWeight = mc_matrix.integral(total);
+
+      if (prepared.mcWeight) {
+        double entries = 0;
+        for (TH1* h: mc_histograms)
+          entries += h->GetEntries();
+
+        mc_histo_stat_only.reset(static_cast<TH1*>(mc_histograms[0]->Clone()));
+        mc_histo_stat_only->SetDirectory(nullptr);
+        mc_matrix.toHistogram(total, mc_histo_stat_only.get());
+        mc_histo_stat_only->ResetStats();
+        mc_histo_stat_only->SetEntries(entries);
+      }
     }
 
     if (plot.normalized) {
       // Normalized each plot
-      for (File& file: m_plotIt.getFiles()) {
-        TH1* h = dynamic_cast<TH1*>(file.object);
-        if (file.type == MC) {
-          h->Scale(1. / fabs(mcWeight));
-        } else if (file.type == SIGNAL) {
+      for (size_t i = 0; i < files.size(); i++) {
+        TH1* h = dynamic_cast<TH1*>(prepared.files[i].object);
+        if (files[i].type == MC) {
+          h->Scale(1. / fabs(prepared.mcWeight));
+        } else if (files[i].type == SIGNAL) {
           h->Scale(1. / fabs(h->GetSumOfWeights()));
         }
       }
 
+      if (mc_histo_stat_only.get())
+        mc_matrix.scale(1. / fabs(prepared.mcWeight));
+
       if (h_data.get()) {
         h_data->Scale(1. / h_data->GetSumOfWeights());
       }
     }
 
+    // Layers are only materialized when there is something to draw. Each one is styled like its first file
+    if (mc_histo_stat_only.get()) {
+      size_t first = 0;
+      for (size_t sample = 0; sample < mc_samples.size(); sample++) {
+        if (sample > 0 && mc_samples[sample - 1].first != mc_samples[sample].first)
+          first = sample;
+
+        // Only the top of each layer is drawn
+        if (sample + 1 < mc_samples.size() && mc_samples[sample + 1].first == mc_samples[sample].first)
+          continue;
+
+        std::shared_ptr<TH1> layer(static_cast<TH1*>(mc_histograms[first]->Clone()));
+        layer->SetDirectory(nullptr);
+        mc_matrix.toHistogram(sample, layer.get());
+
+        prepared.mc_layers.push_back(std::make_pair(layer, &m_plotIt.getPlotStyle(files[mc_samples[first].second])->drawing_options));
+      }
+    }
+
     if (mc_histo_stat_only.get()) {
       mc_histo_syst_only.reset(static_cast<TH1*>(mc_histo_stat_only->Clone()));
       mc_histo_syst_only->SetDirectory(nullptr);
@@ -133,29 +229,30 @@ namespace plotIt {
     }
 
     if (mc_histo_syst_only.get() && plot.show_errors) {
-      if (m_plotIt.getConfiguration().luminosity_error_percent > 0) {
+      if (config.luminosity_error_percent > 0) {
         // Loop over all bins, and add lumi error
         for (uint32_t i = 1; i <= (uint32_t) mc_histo_syst_only->GetNbinsX(); i++) {
           float error = mc_histo_syst_only->GetBinError(i);
           float entries = mc_histo_syst_only->GetBinContent(i);
-          float lumi_error = entries * m_plotIt.getConfiguration().luminosity_error_percent;
+          float lumi_error = entries * config.luminosity_error_percent;
 
           mc_histo_syst_only->SetBinError(i, std::sqrt(error * error + lumi_error * lumi_error));
         }
       }
 
       // Check if systematic histogram are attached, and add them to the plot
-      for (File& file: m_plotIt.getFiles()) {
-        if (file.type != MC || file.systematics.size() == 0)
+      for (size_t f = 0; f < files.size(); f++) {
+        PreparedFile& prepared_file = prepared.files[f];
+        if (files[f].type != MC || prepared_file.systematics.size() == 0)
           continue;
 
-        TH1* nominal = dynamic_cast<TH1*>(file.object);
+        TH1* nominal = dynamic_cast<TH1*>(prepared_file.object);
 
-        for (Systematic& syst: file.systematics) {
+        for (size_t s = 0; s < prepared_file.systematics.size(); s++) {
           // This histogram should contains syst errors
           // in percent
           float total_syst_error = 0;
-          TH1* h = dynamic_cast<TH1*>(syst.object);
+          TH1* h = dynamic_cast<TH1*>(prepared_file.systematics[s]);
           for (uint32_t i = 1; i <= (uint32_t) mc_histo_syst_only->GetNbinsX(); i++) {
             float total_error = mc_histo_syst_only->GetBinError(i);
             float syst_error_percent = h->GetBinError(i);
@@ -166,8 +263,8 @@ namespace plotIt {
             mc_histo_syst_only->SetBinError(i, std::sqrt(total_error * total_error + syst_error * syst_error));
           }
 
-          syst.summary.n_events = file.summary.n_events;
-          syst.summary.n_events_error = total_syst_error;
+          prepared_file.systematics_summary[s].n_events = prepared_file.summary.n_events;
+          prepared_file.systematics_summary[s].n_events_error = total_syst_error;
         }
       }
 
@@ -179,154 +276,204 @@ namespace plotIt {
       }
     }
 
-    // Store all the histograms to draw, and find the one with the highest maximum
-    std::vector<std::pair<TObject*, std::string>> toDraw = { std::make_pair(mc_stack.get(), ""), std::make_pair(h_data.get(), data_drawing_options) };
-    for (File& signal: signal_files) {
-      toDraw.push_back(std::make_pair(signal.object, m_plotIt.getPlotStyle(signal)->drawing_options));
+    // Ratio, only drawn if there is both data and MC
+    prepared.h_ratio.reset();
+    prepared.h_ratio_systematics.reset();
+    if (plot.show_ratio && h_data.get() && mc_histo_stat_only.get()) {
+      std::shared_ptr<TH1>& h_ratio = prepared.h_ratio;
+      h_ratio.reset(static_cast<TH1*>(h_data->Clone()));
+      h_ratio->SetDirectory(nullptr);
+
+      std::shared_ptr<TH1>& h_systematics = prepared.h_ratio_systematics;
+      h_systematics.reset(static_cast<TH1*>(h_data->Clone()));
+      h_systematics->SetDirectory(nullptr);
+      h_systematics->SetMarkerSize(0);
+
+      // Ratio, and systematic errors around it, in one pass
+      computeRatio(plot.ratio_type, h_data.get(), mc_histo_stat_only.get(), mc_histo_syst_only.get(), h_ratio.get(), h_systematics.get(), buffers.ratio);
+
+      switch (plot.ratio_type) {
+        case RATIO:
+          h_ratio->SetMaximum(2);
+          h_ratio->SetMinimum(0);
+          break;
+
+        case PULL:
+        case SIGNIFICANCE:
+          h_ratio->SetMaximum(3.5);
+          h_ratio->SetMinimum(-3.5);
+          break;
+      }
+    }
+  }
+
+  /**
+   * Draw the histograms computed by 'prepare'. Must run on the main thread
+   **/
+  bool TH1Plotter::draw(Plot& plot, PreparedPlot& p) {
+    TH1PreparedPlot& prepared = static_cast<TH1PreparedPlot&>(p);
+
+    const Configuration& config = m_plotIt.getConfiguration();
+    std::vector<File>& files = m_plotIt.getFiles();
+
+    std::shared_ptr<TH1>& mc_histo_stat_only = prepared.mc_histo_stat_only;
+    std::shared_ptr<TH1>& mc_histo_stat_syst = prepared.mc_histo_stat_syst;
+    std::shared_ptr<TH1>& h_data = prepared.h_data;
+
+    for (auto& layer: prepared.mc_layers) {
+      m_plotIt.addTemporaryObject(layer.first);
+    }
+
+    // Keep the computed histograms, if requested
+    for (File& file: files) {
+      m_plotIt.exportObject(m_plotIt.getSampleName(file), file.object);
     }
+    m_plotIt.exportObject("mc_stat_only", mc_histo_stat_only.get());
+    m_plotIt.exportObject("mc_syst_only", prepared.mc_histo_syst_only.get());
+    m_plotIt.exportObject("mc_stat_syst", mc_histo_stat_syst.get());
+    m_plotIt.exportObject("data", h_data.get());
 
-    // Remove NULL items
-    toDraw.erase(
-        std::remove_if(toDraw.begin(), toDraw.end(), [](std::pair<TObject*, std::string>& element) {
-          return element.first == nullptr;
-        }), toDraw.end()
-      );
+    // Store all the histograms to draw, and find the one with the highest maximum
+    // Only pointers to the drawing options are stored, so that no string is copied
+    std::vector<Drawable>& toDraw = m_toDraw;
+    toDraw.clear();
+
+    // The top layer of the stack is the total of the MC
+    if (! prepared.mc_layers.empty())
+      toDraw.push_back(Drawable(prepared.mc_layers.back().first.get(), prepared.mc_layers.back().second));
+    if (h_data.get())
+      toDraw.push_back(Drawable(h_data.get(), &prepared.data_drawing_options));
+    for (size_t index: prepared.signal_files) {
+      if (m_plotIt.isScanPoint(index))
+        continue;
+
+      toDraw.push_back(Drawable(static_cast<TH1*>(files[index].object), &m_plotIt.getPlotStyle(files[index])->drawing_options));
+    }
 
     if (!toDraw.size()) {
-      std::cerr << "Error: nothing to draw." << std::endl;
+      LOG(ERROR) << "nothing to draw.";
       return false;
     };
 
-    // Sort object by minimum
-    std::sort(toDraw.begin(), toDraw.end(), [](std::pair<TObject*, std::string> a, std::pair<TObject*, std::string> b) {
-        return getMinimum(a.first) < getMinimum(b.first);
-      });
+    for (Drawable& drawable: toDraw) {
+      drawable.computeExtrema(plot);
+    }
 
-    float minimum = getMinimum(toDraw[0].first);
+    float minimum = std::min_element(toDraw.begin(), toDraw.end(), [](const Drawable& a, const Drawable& b) {
+        return a.getMinimum() < b.getMinimum();
+      })->getMinimum();
 
-    // Sort objects by maximum
-    std::sort(toDraw.begin(), toDraw.end(), [](std::pair<TObject*, std::string> a, std::pair<TObject*, std::string> b) {
-        return getMaximum(a.first) > getMaximum(b.first);
+    // The object with the highest maximum is drawn first, and defines the axis
+    std::vector<Drawable>::iterator highest = std::max_element(toDraw.begin(), toDraw.end(), [](const Drawable& a, const Drawable& b) {
+        return a.getMaximum() < b.getMaximum();
       });
+    std::iter_swap(toDraw.begin(), highest);
 
-    float maximum = getMaximum(toDraw[0].first);
+    Drawable& first = toDraw[0];
+    float maximum = first.getMaximum();
 
-    if ((!h_data.get() || !mc_histo_stat_only.get()))
-      plot.show_ratio = false;
+    // Points of a signal scan are drawn later by plotIt, one at a time, but all share this axis
+    for (size_t index: prepared.signal_files) {
+      if (! m_plotIt.isScanPoint(index))
+        continue;
 
-    std::shared_ptr<TPad> hi_pad;
-    std::shared_ptr<TPad> low_pad;
-    if (plot.show_ratio) {
-      hi_pad = std::make_shared<TPad>("pad_hi", "", 0., 0.33333, 1, 1);
-      hi_pad->Draw();
-      hi_pad->SetTopMargin(TOP_MARGIN / .6666);
-      hi_pad->SetLeftMargin(LEFT_MARGIN);
-      hi_pad->SetBottomMargin(0.015);
-      hi_pad->SetRightMargin(RIGHT_MARGIN);
-
-      low_pad = std::make_shared<TPad>("pad_lo", "", 0., 0., 1, 0.33333);
-      low_pad->Draw();
-      low_pad->SetLeftMargin(LEFT_MARGIN);
-      low_pad->SetTopMargin(1.);
-      low_pad->SetBottomMargin(BOTTOM_MARGIN / .3333);
-      low_pad->SetRightMargin(RIGHT_MARGIN);
-      low_pad->SetTickx(1);
-
-      hi_pad->cd();
-      if (plot.log_y)
-        hi_pad->SetLogy();
+      Drawable point(static_cast<TH1*>(files[index].object), &s_empty_options);
+      point.computeExtrema(plot);
+      minimum = std::min(minimum, point.getMinimum());
+      maximum = std::max(maximum, point.getMaximum());
     }
 
-    toDraw[0].first->Draw(toDraw[0].second.c_str());
-    setRange(toDraw[0].first, plot);
+    if (! prepared.h_ratio.get())
+      plot.show_ratio = false;
+
+    CanvasLayout& layout = m_plotIt.getCanvasLayout(plot.show_ratio);
+    layout.clear(plot.log_y);
+
+    first.get()->Draw(first.getOptions().c_str());
+    first.setRange(plot);
 
     float safe_margin = 1.20;
     if (plot.log_y)
       safe_margin = 8;
 
     if (plot.y_axis_range.size() != 2) {
-      setMaximum(toDraw[0].first, maximum * safe_margin);
+      first.setMaximum(maximum * safe_margin);
 
       if (minimum <= 0 && plot.log_y) {
         minimum = 0.1;
       }
-      setMinimum(toDraw[0].first, minimum * 1.20);
+      first.setMinimum(minimum * 1.20);
     }
 
-    // First, draw MC
-    if (mc_stack.get()) {
-      mc_stack->Draw("same");
-      m_plotIt.addTemporaryObject(mc_stack);
+    // First, draw MC. Each layer includes the ones below, so they are drawn from the top of the stack
+    for (auto it = prepared.mc_layers.rbegin(); it != prepared.mc_layers.rend(); ++it) {
+      if (it->first.get() == first.get())
+        continue;
+
+      m_options = *it->second;
+      m_options += " same";
+      it->first->Draw(m_options.c_str());
     }
 
     // Then, if requested, errors
     if (mc_histo_stat_syst.get() && plot.show_errors) {
       mc_histo_stat_syst->SetMarkerSize(0);
       mc_histo_stat_syst->SetMarkerStyle(0);
-      mc_histo_stat_syst->SetFillStyle(m_plotIt.getConfiguration().error_fill_style);
-      mc_histo_stat_syst->SetFillColor(m_plotIt.getConfiguration().error_fill_color);
+      mc_histo_stat_syst->SetFillStyle(config.error_fill_style);
+      mc_histo_stat_syst->SetFillColor(config.error_fill_color);
 
       mc_histo_stat_syst->Draw("E2 same");
       m_plotIt.addTemporaryObject(mc_histo_stat_syst);
     }
 
     // Then signal
-    for (File& signal: signal_files) {
-      std::string options = m_plotIt.getPlotStyle(signal)->drawing_options + " same";
-      signal.object->Draw(options.c_str());
+    for (size_t index: prepared.signal_files) {
+      if (m_plotIt.isScanPoint(index))
+        continue;
+
+      m_options = m_plotIt.getPlotStyle(files[index])->drawing_options;
+      m_options += " same";
+      files[index].object->Draw(m_options.c_str());
     }
 
     // And finally data
     if (h_data.get()) {
-      data_drawing_options += " E X0 same";
-      h_data->Draw(data_drawing_options.c_str());
+      prepared.data_drawing_options += " E X0 same";
+      h_data->Draw(prepared.data_drawing_options.c_str());
       m_plotIt.addTemporaryObject(h_data);
     }
     
     // Set x and y axis titles, and default style
-    for (auto& obj: toDraw) {
-      setDefaultStyle(obj.first, (plot.show_ratio) ? 0.6666 : 1.);
-      setAxisTitles(obj.first, plot);
+    for (Drawable& drawable: toDraw) {
+      drawable.setDefaultStyle((plot.show_ratio) ? 0.6666 : 1.);
+      drawable.setAxisTitles(plot);
     }
 
     // Redraw only axis
-    toDraw[0].first->Draw("axis same");
+    first.get()->Draw("axis same");
 
     if (plot.show_ratio) {
 
       // Compute ratio and draw it
-      low_pad->cd();
-      low_pad->SetGridy();
+      layout.getRatioPad()->cd();
 
-      std::shared_ptr<TH1> h_data_cloned(static_cast<TH1*>(h_data->Clone()));
-      h_data_cloned->SetDirectory(nullptr);
-      h_data_cloned->Divide(mc_histo_stat_only.get());
-      h_data_cloned->SetMaximum(2);
-      h_data_cloned->SetMinimum(0);
+      std::shared_ptr<TH1> h_data_cloned = prepared.h_ratio;
+      std::shared_ptr<TH1> h_systematics = prepared.h_ratio_systematics;
 
       setDefaultStyle(h_data_cloned.get(), 1. / 0.3333);
+      if (plot.ratio_type == PULL)
+        h_data_cloned->GetYaxis()->SetTitle("#frac{Data - MC}{#sigma}");
+      else if (plot.ratio_type == SIGNIFICANCE)
+        h_data_cloned->GetYaxis()->SetTitle("Significance");
       h_data_cloned->GetYaxis()->SetTickLength(0.04);
       h_data_cloned->GetYaxis()->SetNdivisions(505, true);
       h_data_cloned->GetXaxis()->SetTickLength(0.07);
 
-      // Compute systematic errors in %
-      std::shared_ptr<TH1> h_systematics(static_cast<TH1*>(h_data_cloned->Clone()));
-      h_systematics->SetDirectory(nullptr);
-      h_systematics->Reset(); // Keep binning
-      h_systematics->SetMarkerSize(0);
-
-      for (uint32_t i = 1; i <= (uint32_t) h_systematics->GetNbinsX(); i++) {
-
-        if (mc_histo_syst_only->GetBinContent(i) == 0)
-          continue;
-
-        float syst = mc_histo_syst_only->GetBinContent(i) / (mc_histo_syst_only->GetBinError(i) + mc_histo_syst_only->GetBinContent(i));
-        h_systematics->SetBinContent(i, 1);
-        h_systematics->SetBinError(i, 1 - syst);
-      }
+      m_plotIt.exportObject("ratio", h_data_cloned.get());
+      m_plotIt.exportObject("ratio_systematics", h_systematics.get());
 
-      h_systematics->SetFillStyle(m_plotIt.getConfiguration().error_fill_style);
-      h_systematics->SetFillColor(m_plotIt.getConfiguration().error_fill_color);
+      h_systematics->SetFillStyle(config.error_fill_style);
+      h_systematics->SetFillColor(config.error_fill_color);
       h_systematics->Draw("E2");
 
       h_data_cloned->Draw("P E X0 same");
@@ -334,22 +481,27 @@ namespace plotIt {
       if (plot.fit_ratio) {
         float xMin = h_data_cloned->GetXaxis()->GetBinLowEdge(1);
         float xMax = h_data_cloned->GetXaxis()->GetBinUpEdge(h_data_cloned->GetXaxis()->GetLast());
-        std::shared_ptr<TF1> fct = std::make_shared<TF1>("fit_function", plot.fit_function.c_str(), xMin, xMax);
-
-        h_data_cloned->Fit(fct.get(), "MRNEQ");
 
         std::shared_ptr<TH1> errors = std::make_shared<TH1D>("errors", "errors", 100, xMin, xMax);
         errors->SetDirectory(nullptr);
-        (TVirtualFitter::GetFitter())->GetConfidenceIntervals(errors.get(), 0.68);
+
+        // Owned by the fitter, and reused by the next plots
+        TF1* fct = m_ratio_fitter.fit(h_data_cloned.get(), plot.fit_function, xMin, xMax, errors.get(), 0.68);
+        if (! fct)
+          return false;
+
+        m_plotIt.exportObject("fit_function", fct);
+        m_plotIt.exportObject("fit_errors", errors.get());
+
         errors->SetStats(false);
         errors->SetMarkerSize(0);
-        errors->SetFillColor(m_plotIt.getConfiguration().ratio_fit_error_fill_color);
-        errors->SetFillStyle(m_plotIt.getConfiguration().ratio_fit_error_fill_style);
+        errors->SetFillColor(config.ratio_fit_error_fill_color);
+        errors->SetFillStyle(config.ratio_fit_error_fill_style);
         errors->Draw("e3 same");
 
-        fct->SetLineWidth(m_plotIt.getConfiguration().ratio_fit_line_width);
-        fct->SetLineColor(m_plotIt.getConfiguration().ratio_fit_line_color);
-        fct->SetLineStyle(m_plotIt.getConfiguration().ratio_fit_line_style);
+        fct->SetLineWidth(config.ratio_fit_line_width);
+        fct->SetLineColor(config.ratio_fit_line_color);
+        fct->SetLineStyle(config.ratio_fit_line_style);
         fct->Draw("same");
 
         if (plot.fit_legend.length() > 0) {
@@ -374,36 +526,28 @@ namespace plotIt {
         }
 
         m_plotIt.addTemporaryObject(errors);
-        m_plotIt.addTemporaryObject(fct);
       }
 
       h_data_cloned->Draw("P E X0 same");
 
       // Hide top pad label
-      hideXTitle(toDraw[0].first);
+      first.hideXTitle();
 
       m_plotIt.addTemporaryObject(h_data_cloned);
       m_plotIt.addTemporaryObject(h_systematics);
-      m_plotIt.addTemporaryObject(hi_pad);
-      m_plotIt.addTemporaryObject(low_pad);
     }
 
     gPad->Modified();
     gPad->Update();
     gPad->RedrawAxis();
 
-    if (hi_pad.get())
-      hi_pad->cd();
+    layout.getMainPad().cd();
 
     return true;
-  
-    return true;
   }
 
-  void TH1Plotter::setHistogramStyle(const File& file) {
-    TH1* h = dynamic_cast<TH1*>(file.object);
-
-    std::shared_ptr<PlotStyle> style = m_plotIt.getPlotStyle(file);
+  void TH1Plotter::setHistogramStyle(const File& file, TH1* h) {
+    const std::shared_ptr<PlotStyle>& style = m_plotIt.getPlotStyle(file);
 
     if (style->fill_color != -1)
       h->SetFillColor(style->fill_color);
@@ -0,0 +1,263 @@
+#include <TreeFiller.h>
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TTree.h>
+#include <TTreeFormula.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+#include <boost/format.hpp>
+
+#include <logging.h>
+#include <utilities.h>
+
+namespace plotIt {
+
+  TreeFiller::TreeFiller(const fs::path& cacheDirectory, uint16_t threads):
+    m_cacheDirectory(cacheDirectory), m_threads(threads) {
+    }
+
+  bool TreeFiller::fill(const std::string& path, const std::string& treeName, const std::vector<Histogram>& histograms, std::map<std::string, std::shared_ptr<TH1>>& result) {
+    result.clear();
+
+    std::string uuid;
+    int64_t entries = 0;
+    {
+      std::shared_ptr<TFile> file(TFile::Open(path.c_str()));
+      if (! file.get() || file->IsZombie()) {
+        LOG(ERROR) << "cannot open file '" << path << "'";
+        return false;
+      }
+
+      TTree* tree = dynamic_cast<TTree*>(file->Get(treeName.c_str()));
+      if (! tree) {
+        LOG(ERROR) << "tree '" << treeName << "' not found in file '" << path << "'";
+        return false;
+      }
+
+      uuid = file->GetUUID().AsString();
+      entries = tree->GetEntries();
+    }
+
+    fs::path cachePath;
+    if (! m_cacheDirectory.empty()) {
+      cachePath = getCachePath(uuid, treeName, entries, histograms);
+      if (loadFromCache(cachePath, histograms, result)) {
+        LOG(INFO) << histograms.size() << " histogram(s) of tree '" << treeName << "' in '" << path << "' read from the cache";
+        return true;
+      }
+    }
+
+    LOG(INFO) << "Filling " << histograms.size() << " histogram(s) from " << entries << " entries of tree '" << treeName << "' in '" << path << "'";
+
+    uint16_t threads = enableThreadSafety(m_threads);
+
+    // Histograms of each entry range, indexed by the first entry of the range
+    std::map<size_t, std::vector<std::shared_ptr<TH1>>> partials;
+    std::vector<std::string> errors;
+    std::mutex mutex;
+
+    parallelFor(entries, threads, [&](size_t begin, size_t end) {
+        // ROOT objects read from a file are not thread safe, each range has its own handles
+        std::shared_ptr<TFile> file(TFile::Open(path.c_str()));
+        TTree* tree = file.get() ? dynamic_cast<TTree*>(file->Get(treeName.c_str())) : nullptr;
+        if (! tree) {
+          std::lock_guard<std::mutex> lock(mutex);
+          errors.push_back("cannot read tree '" + treeName + "' from '" + path + "'");
+          return;
+        }
+
+        tree->SetCacheSize(32 * 1024 * 1024);
+        tree->SetCacheEntryRange(begin, end);
+
+        // Each selection is evaluated once per entry, even if used by several histograms
+        std::vector<std::shared_ptr<TTreeFormula>> cuts;
+        std::map<std::string, size_t> cutIndices;
+
+        std::vector<std::shared_ptr<TTreeFormula>> variables;
+        std::vector<int> histogramCuts;
+        std::vector<std::shared_ptr<TH1>> filled;
+
+        for (const Histogram& histogram: histograms) {
+          std::shared_ptr<TTreeFormula> variable = std::make_shared<TTreeFormula>(histogram.name.c_str(), histogram.variable.c_str(), tree);
+          if (variable->GetNdim() == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            errors.push_back("invalid expression '" + histogram.variable + "' for '" + histogram.name + "'");
+            return;
+          }
+          variables.push_back(variable);
+
+          int cut = -1;
+          if (! histogram.cut.empty()) {
+            auto it = cutIndices.find(histogram.cut);
+            if (it == cutIndices.end()) {
+              std::shared_ptr<TTreeFormula> formula = std::make_shared<TTreeFormula>("cut", histogram.cut.c_str(), tree);
+              if (formula->GetNdim() == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                errors.push_back("invalid selection '" + histogram.cut + "' for '" + histogram.name + "'");
+                return;
+              }
+
+              it = cutIndices.insert(std::make_pair(histogram.cut, cuts.size())).first;
+              cuts.push_back(formula);
+            }
+
+            cut = it->second;
+          }
+          histogramCuts.push_back(cut);
+
+          std::shared_ptr<TH1> h = std::make_shared<TH1D>(histogram.name.c_str(), histogram.name.c_str(), (int) histogram.binning[0], histogram.binning[1], histogram.binning[2]);
+          h->SetDirectory(nullptr);
+          h->Sumw2();
+          filled.push_back(h);
+        }
+
+        // Array expressions have several values per entry
+        std::vector<bool> arrayCuts;
+        for (auto& cut: cuts)
+          arrayCuts.push_back(cut->GetMultiplicity() != 0);
+
+        std::vector<bool> arrayVariables;
+        for (auto& variable: variables)
+          arrayVariables.push_back(variable->GetMultiplicity() != 0);
+
+        std::vector<double> weights(cuts.size());
+        std::vector<int> cutSizes(cuts.size());
+        for (size_t entry = begin; entry < end; entry++) {
+          if (tree->LoadTree(entry) < 0)
+            break;
+
+          // Like TTree::Draw, the selection is used as a weight. A scalar selection
+          // weights every value of the variable, while the values of an array
+          // selection are paired with the values of the variable of the same index
+          for (size_t i = 0; i < cuts.size(); i++) {
+            cutSizes[i] = cuts[i]->GetNdata();
+            weights[i] = (cutSizes[i] && ! arrayCuts[i]) ? cuts[i]->EvalInstance(0) : 0;
+          }
+
+          for (size_t i = 0; i < variables.size(); i++) {
+            int cut = histogramCuts[i];
+            bool arrayCut = (cut >= 0) && arrayCuts[cut];
+
+            double weight = (cut < 0) ? 1 : weights[cut];
+            if (weight == 0 && ! arrayCut)
+              continue;
+
+            int n_values = variables[i]->GetNdata();
+            if (arrayCut)
+              n_values = arrayVariables[i] ? std::min(n_values, cutSizes[cut]) : (n_values ? cutSizes[cut] : 0);
+
+            for (int j = 0; j < n_values; j++) {
+              if (arrayCut) {
+                weight = cuts[cut]->EvalInstance(j);
+                if (weight == 0)
+                  continue;
+              }
+
+              filled[i]->Fill(variables[i]->EvalInstance(arrayVariables[i] ? j : 0), weight);
+            }
+          }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        partials[begin] = filled;
+      });
+
+    if (! errors.empty()) {
+      for (const std::string& error: errors)
+        LOG(ERROR) << error;
+      return false;
+    }
+
+    // Merge the ranges, always in the same order
+    for (size_t i = 0; i < histograms.size(); i++) {
+      std::vector<TH1*> ranges;
+      for (auto& partial: partials)
+        ranges.push_back(partial.second[i].get());
+
+      std::shared_ptr<TH1> h;
+      if (ranges.empty()) {
+        // Empty tree
+        h = std::make_shared<TH1D>(histograms[i].name.c_str(), histograms[i].name.c_str(), (int) histograms[i].binning[0], histograms[i].binning[1], histograms[i].binning[2]);
+        h->SetDirectory(nullptr);
+        h->Sumw2();
+      } else {
+        h.reset(sumHistograms(ranges, threads));
+      }
+
+      result[histograms[i].name] = h;
+    }
+
+    if (! cachePath.empty())
+      saveToCache(cachePath, result);
+
+    return true;
+  }
+
+  fs::path TreeFiller::getCachePath(const std::string& uuid, const std::string& tree, int64_t entries, const std::vector<Histogram>& histograms) {
+    // Bumped when the way histograms are filled changes
+    const uint32_t version = 2;
+
+    std::stringstream key;
+    key << version << '\n' << uuid << '\n' << tree << '\n' << entries << '\n';
+    for (const Histogram& histogram: histograms) {
+      key << histogram.name << '\n' << histogram.variable << '\n' << histogram.cut << '\n';
+      for (float value: histogram.binning)
+        key << value << ' ';
+      key << '\n';
+    }
+
+    return m_cacheDirectory / (boost::format("%016x.root") % stableHash(key.str())).str();
+  }
+
+  bool TreeFiller::loadFromCache(const fs::path& path, const std::vector<Histogram>& histograms, std::map<std::string, std::shared_ptr<TH1>>& result) {
+    if (! fs::exists(path))
+      return false;
+
+    std::shared_ptr<TFile> file(TFile::Open(path.string().c_str()));
+    if (! file.get() || file->IsZombie())
+      return false;
+
+    for (const Histogram& histogram: histograms) {
+      TH1* h = dynamic_cast<TH1*>(file->Get(histogram.name.c_str()));
+      if (! h) {
+        result.clear();
+        return false;
+      }
+
+      h->SetDirectory(nullptr);
+      result[histogram.name].reset(h);
+    }
+
+    return true;
+  }
+
+  /**
+   * Write the histograms into the cache. The file is written under a temporary
+   * name, then renamed, so that other processes never read a partial file.
+   **/
+  void TreeFiller::saveToCache(const fs::path& path, const std::map<std::string, std::shared_ptr<TH1>>& result) {
+    boost::system::error_code error;
+    fs::create_directories(m_cacheDirectory, error);
+
+    fs::path temporaryPath = path;
+    temporaryPath += ".tmp-" + std::to_string(getpid());
+
+    std::shared_ptr<TFile> file(TFile::Open(temporaryPath.string().c_str(), "recreate"));
+    if (! file.get() || file->IsZombie()) {
+      LOG(WARNING) << "cannot write into the tree cache '" << m_cacheDirectory << "'";
+      return;
+    }
+
+    for (auto& h: result)
+      file->WriteTObject(h.second.get(), h.first.c_str());
+    file->Close();
+
+    fs::rename(temporaryPath, path, error);
+  }
+}
@@ -0,0 +1,69 @@
+#include <allocations.h>
+
+#ifdef PLOTIT_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> s_allocations(0);
+
+void* operator new(std::size_t size) {
+  s_allocations++;
+
+  void* p = std::malloc(size ? size : 1);
+  if (! p)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  s_allocations++;
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+#endif
+
+namespace plotIt {
+
+  uint64_t getAllocationsCount() {
+#ifdef PLOTIT_COUNT_ALLOCATIONS
+    return s_allocations.load();
+#else
+    return 0;
+#endif
+  }
+
+  bool isAllocationsCountEnabled() {
+#ifdef PLOTIT_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+  }
+}
@@ -0,0 +1,254 @@
+#include "plotIt.h"
+
+#include <TH1.h>
+#include <TMath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <set>
+
+#include <boost/format.hpp>
+
+#include <InputStore.h>
+#include <logging.h>
+#include <utilities.h>
+
+/**
+ * Comparison of two productions: '--compare-with OTHER_ROOT' reads every
+ * object of every file both from the configured root and from OTHER_ROOT,
+ * and compares them bin by bin without drawing anything. The comparisons
+ * are ranked in 'comparison.yml', and only the plots where the productions
+ * are incompatible are drawn, once with each production.
+ **/
+
+namespace plotIt {
+
+  struct Comparison {
+    std::string plot;
+    std::string sample;
+
+    // The object is missing in one of the productions, or the binnings differ
+    bool missing = false;
+
+    double yield = 0;
+    double compared_yield = 0;
+
+    double chi2 = 0;
+    uint32_t ndf = 0;
+    double chi2_probability = 1;
+    double ks_probability = 1;
+
+    // Largest difference in a bin, in units of the combined error of the bin
+    double max_pull = 0;
+  };
+
+  /**
+   * Compare the bins of 'reference' and 'compared', under- and overflows
+   * excluded. Empty bins in both productions are ignored
+   **/
+  static void compareHistograms(const TH1* reference, const TH1* compared, Comparison& comparison) {
+    if (reference->GetNcells() != compared->GetNcells()) {
+      comparison.missing = true;
+      return;
+    }
+
+    comparison.yield = reference->GetSumOfWeights();
+    comparison.compared_yield = compared->GetSumOfWeights();
+
+    for (int bin = 0; bin < reference->GetNcells(); bin++) {
+      if (reference->IsBinUnderflow(bin) || reference->IsBinOverflow(bin))
+        continue;
+
+      double difference = reference->GetBinContent(bin) - compared->GetBinContent(bin);
+      double error1 = reference->GetBinError(bin);
+      double error2 = compared->GetBinError(bin);
+      double variance = error1 * error1 + error2 * error2;
+
+      if (variance == 0) {
+        // No statistical error: only identical bins are compatible
+        if (difference != 0)
+          comparison.max_pull = std::numeric_limits<double>::infinity();
+        continue;
+      }
+
+      double pull = difference / std::sqrt(variance);
+      comparison.chi2 += pull * pull;
+      comparison.ndf++;
+      comparison.max_pull = std::max(comparison.max_pull, std::abs(pull));
+    }
+
+    // An empty object in only one production is as incompatible as it gets
+    if (std::isinf(comparison.max_pull) || ((comparison.yield == 0) != (comparison.compared_yield == 0)))
+      comparison.chi2_probability = 0;
+    else if (comparison.ndf > 0)
+      comparison.chi2_probability = TMath::Prob(comparison.chi2, comparison.ndf);
+
+    if (comparison.yield > 0 && comparison.compared_yield > 0)
+      comparison.ks_probability = reference->KolmogorovTest(compared);
+  }
+
+  /**
+   * Path of 'path' in the compared production: the configured root is replaced by 'compare_with'
+   **/
+  std::string plotIt::getComparedPath(const std::string& path) {
+    std::string root = fs::path(m_config.root).string();
+    std::string relative = path;
+    if (relative.compare(0, root.size(), root) == 0)
+      relative = relative.substr(root.size());
+
+    return (fs::path(m_config.compare_with) / relative).string();
+  }
+
+  bool plotIt::compareAll() {
+    std::vector<Plot> plots;
+    if (! expandObjects(m_files[0], plots))
+      return false;
+
+    if (m_config.shard_count > 1)
+      selectShard(plots);
+
+    createInputStore();
+
+    uint16_t threads = enableThreadSafety(m_config.threads);
+
+    std::vector<Comparison> comparisons;
+
+    // Objects are read on this thread, a batch of plots at a time, and compared on all threads
+    const size_t batch_size = 16 * std::max<uint16_t>(threads, 1);
+    for (size_t begin = 0; begin < plots.size(); begin += batch_size) {
+      size_t end = std::min(begin + batch_size, plots.size());
+
+      std::vector<std::shared_ptr<TObject>> references;
+      std::vector<std::shared_ptr<TObject>> compared;
+      size_t first = comparisons.size();
+
+      for (size_t p = begin; p < end; p++) {
+        const Plot& plot = plots[p];
+        Logger::get().setContext(plot.name);
+
+        for (const File& file: m_files) {
+          // Histograms filled from trees are not compared
+          if (! file.tree.empty())
+            continue;
+
+          Comparison comparison;
+          comparison.plot = plot.name;
+          comparison.sample = getSampleName(file);
+          comparisons.push_back(comparison);
+
+          references.push_back(m_inputs->takeObject(getInputPath(file.path), plot.name));
+          compared.push_back(m_inputs->takeObject(getInputPath(getComparedPath(file.path)), plot.name));
+        }
+      }
+
+      parallelFor(references.size(), threads, [&](size_t begin, size_t end) {
+          for (size_t i = begin; i < end; i++) {
+            const TH1* reference = dynamic_cast<const TH1*>(references[i].get());
+            const TH1* other = dynamic_cast<const TH1*>(compared[i].get());
+
+            if (! references[i].get() || ! compared[i].get()) {
+              comparisons[first + i].missing = true;
+            } else if (reference && other) {
+              compareHistograms(reference, other, comparisons[first + i]);
+            }
+          }
+        });
+    }
+    Logger::get().setContext("");
+
+    // Most incompatible first
+    std::stable_sort(comparisons.begin(), comparisons.end(), [](const Comparison& a, const Comparison& b) {
+        if (a.missing != b.missing)
+          return a.missing;
+
+        if (a.chi2_probability != b.chi2_probability)
+          return a.chi2_probability < b.chi2_probability;
+
+        return a.ks_probability < b.ks_probability;
+      });
+
+    std::set<std::string> incompatible;
+    YAML::Node report;
+    report["reference"] = m_config.root;
+    report["compared"] = m_config.compare_with;
+    report["threshold"] = m_config.compare_threshold;
+
+    for (const Comparison& comparison: comparisons) {
+      YAML::Node node;
+      node["plot"] = comparison.plot;
+      node["sample"] = comparison.sample;
+
+      if (comparison.missing) {
+        node["missing"] = true;
+      } else {
+        node["yield"] = comparison.yield;
+        node["compared-yield"] = comparison.compared_yield;
+        if (comparison.yield != 0)
+          node["yield-delta"] = (comparison.compared_yield - comparison.yield) / comparison.yield;
+        else if (comparison.compared_yield != 0)
+          node["yield-delta"] = (comparison.compared_yield > 0) ? ".inf" : "-.inf";
+        else
+          node["yield-delta"] = 0;
+        node["chi2"] = comparison.chi2;
+        node["ndf"] = comparison.ndf;
+        node["chi2-probability"] = comparison.chi2_probability;
+        node["ks-probability"] = comparison.ks_probability;
+        node["max-pull"] = comparison.max_pull;
+      }
+
+      report["comparisons"].push_back(node);
+
+      if (comparison.missing || comparison.chi2_probability < m_config.compare_threshold)
+        incompatible.insert(comparison.plot);
+    }
+
+    fs::path reportPath = m_outputPath / "comparison.yml";
+    std::ofstream out(reportPath.string().c_str());
+    out << report << std::endl;
+
+    LOG(NOTICE) << comparisons.size() << " comparison(s) written in " << reportPath << ", " << incompatible.size() << " plot(s) with a chi2 probability below " << m_config.compare_threshold;
+
+    if (incompatible.empty())
+      return true;
+
+    plots.erase(
+        std::remove_if(plots.begin(), plots.end(), [&incompatible](const Plot& plot) {
+          return ! incompatible.count(plot.name);
+          }), plots.end()
+        );
+
+    // Draw the incompatible plots with each production, in its own subfolder
+    fs::path outputPath = m_outputPath;
+    std::vector<File> files = m_files;
+
+    bool success = true;
+    const std::vector<std::string> productions = {"reference", "compared"};
+    for (const std::string& production: productions) {
+      m_outputPath = outputPath / production;
+      fs::create_directories(m_outputPath);
+
+      if (production == "compared") {
+        for (File& file: m_files) {
+          file.path = getComparedPath(file.path);
+          for (Systematic& syst: file.systematics)
+            syst.path = getComparedPath(syst.path);
+        }
+      }
+
+      for (Plot& plot: plots) {
+        Plot copy = plot;
+        success &= plotIt::plot(copy);
+      }
+    }
+    Logger::get().setContext("");
+
+    m_outputPath = outputPath;
+    m_files = files;
+
+    Logger::get().flush();
+
+    return success;
+  }
+}
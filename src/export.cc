@@ -0,0 +1,169 @@
+#include "plotIt.h"
+
+#include <TF1.h>
+#include <TFile.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <boost/format.hpp>
+
+#include <logging.h>
+#include <utilities.h>
+
+/**
+ * Export of the numbers computed while plotting (scaled samples, MC sums,
+ * uncertainty bands, ratio and fit), so that they can be used without
+ * running plotIt again. Objects are either written into one ROOT file per
+ * run, with one directory per plot, or into one JSON file per plot.
+ **/
+
+namespace plotIt {
+
+  // JSON has no NaN nor infinity, for instance in the ratio of an empty bin
+  static void writeJSON(std::ostream& out, double value) {
+    if (std::isfinite(value))
+      out << value;
+    else
+      out << "null";
+  }
+
+  static void writeJSON(std::ostream& out, const TH1& h) {
+    const TAxis* axis = h.GetXaxis();
+    int32_t n_bins = h.GetNbinsX();
+
+    // Bin 0 is the underflow, bin n_bins + 1 the overflow
+    out << "{\"type\": \"TH1\", \"edges\": [";
+    for (int32_t i = 1; i <= n_bins + 1; i++) {
+      out << (i > 1 ? ", " : "");
+      writeJSON(out, axis->GetBinLowEdge(i));
+    }
+
+    out << "], \"contents\": [";
+    for (int32_t i = 0; i <= n_bins + 1; i++) {
+      out << (i > 0 ? ", " : "");
+      writeJSON(out, h.GetBinContent(i));
+    }
+
+    out << "], \"errors\": [";
+    for (int32_t i = 0; i <= n_bins + 1; i++) {
+      out << (i > 0 ? ", " : "");
+      writeJSON(out, h.GetBinError(i));
+    }
+    out << "]}";
+  }
+
+  static void writeJSON(std::ostream& out, const TF1& f) {
+    out << "{\"type\": \"TF1\", \"formula\": \"" << escapeJSON(f.GetTitle()) << "\", \"parameters\": [";
+    for (int32_t i = 0; i < f.GetNpar(); i++) {
+      out << (i > 0 ? ", " : "");
+      writeJSON(out, f.GetParameter(i));
+    }
+
+    out << "], \"errors\": [";
+    for (int32_t i = 0; i < f.GetNpar(); i++) {
+      out << (i > 0 ? ", " : "");
+      writeJSON(out, f.GetParError(i));
+    }
+    out << "], \"chi2\": ";
+    writeJSON(out, f.GetChisquare());
+    out << ", \"ndf\": " << f.GetNDF() << "}";
+  }
+
+  /**
+   * Keep a copy of 'object' to export once the plot is done.
+   * Plotters call this for every intermediate result worth keeping.
+   **/
+  void plotIt::exportObject(const std::string& name, const TObject* object) {
+    if (m_config.export_format.empty() || ! object)
+      return;
+
+    std::shared_ptr<TObject> copy(object->Clone(name.c_str()));
+    if (TH1* h = dynamic_cast<TH1*>(copy.get()))
+      h->SetDirectory(nullptr);
+
+    m_exportedObjects.push_back(std::make_pair(name, copy));
+  }
+
+  fs::path plotIt::getExportPath(const std::string& name, const std::string& extension) {
+    std::string fileName = name;
+    if (m_config.shard_count > 1)
+      fileName += (boost::format("-shard-%d-of-%d") % m_config.shard_index % m_config.shard_count).str();
+
+    // Each worker has its own ROOT file, they can be merged with hadd
+    if (m_workerIndex >= 0 && extension == "root")
+      fileName += (boost::format("-worker-%d") % m_workerIndex).str();
+
+    return m_outputPath / (fileName + "." + extension);
+  }
+
+  void plotIt::writeExportedObjects(const Plot& plot) {
+    if (m_exportedObjects.empty())
+      return;
+
+    if (m_config.export_format == "root") {
+      if (! m_exportFile.get()) {
+        fs::path path = getExportPath("plots_data", "root");
+        m_exportFile.reset(TFile::Open(path.string().c_str(), "recreate"));
+        if (! m_exportFile.get() || m_exportFile->IsZombie()) {
+          LOG(ERROR) << "cannot create export file " << path;
+          m_exportFile.reset();
+          m_exportedObjects.clear();
+          return;
+        }
+      }
+
+      // The same plot can be drawn twice, for both productions with --compare-with,
+      // or by two patterns matching the same object: the next ones are numbered
+      std::string name = plot.name;
+      for (uint32_t i = 2; m_exportFile->GetDirectory(name.c_str()); i++)
+        name = plot.name + "_" + std::to_string(i);
+
+      TDirectory* directory = m_exportFile->mkdir(name.c_str());
+      if (! directory) {
+        LOG(ERROR) << "cannot create directory '" << name << "' in the export file";
+        m_exportedObjects.clear();
+        return;
+      }
+
+      for (auto& object: m_exportedObjects) {
+        // Sample names are paths, but '/' separates directories in ROOT files
+        std::string key = object.first;
+        std::replace(key.begin(), key.end(), '/', '_');
+
+        directory->WriteTObject(object.second.get(), key.c_str());
+      }
+    } else if (m_config.export_format == "json") {
+      std::ofstream out(getExportPath(plot.name, "json").string().c_str());
+      out << "{\"plot\": \"" << escapeJSON(plot.name) << "\", \"objects\": {";
+
+      bool first = true;
+      for (auto& object: m_exportedObjects) {
+        if (const TH1* h = dynamic_cast<const TH1*>(object.second.get())) {
+          out << (first ? "" : ", ") << "\"" << escapeJSON(object.first) << "\": ";
+          writeJSON(out, *h);
+        } else if (const TF1* f = dynamic_cast<const TF1*>(object.second.get())) {
+          out << (first ? "" : ", ") << "\"" << escapeJSON(object.first) << "\": ";
+          writeJSON(out, *f);
+        } else {
+          continue;
+        }
+
+        first = false;
+      }
+
+      out << "}}" << std::endl;
+    }
+
+    m_exportedObjects.clear();
+  }
+
+  void plotIt::closeExportFile() {
+    if (! m_exportFile.get())
+      return;
+
+    m_exportFile->Close();
+    m_exportFile.reset();
+  }
+}
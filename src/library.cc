@@ -0,0 +1,47 @@
+#include "plotIt.h"
+
+#include <TCanvas.h>
+
+#include <CanvasLayout.h>
+#include <logging.h>
+
+/**
+ * Entry points for using plotIt as a library, with objects already in memory
+ * instead of a configuration file and ROOT files
+ **/
+
+namespace plotIt {
+
+  /**
+   * Draw 'plot' from 'objects', given in the same order as the files returned
+   * by getFiles(). Objects of the systematics, if any, must be set on the files
+   * before calling this function.
+   *
+   * The objects are used as they are, without copies: they are scaled, rebinned
+   * and styled in place, and must stay alive as long as the returned canvas is used.
+   * The canvas is owned by plotIt and reused by the next call. The plot is also
+   * saved in the formats listed in 'plot.save_extensions', if any.
+   *
+   * Return nullptr if the plot cannot be drawn
+   **/
+  TCanvas* plotIt::plotObjects(Plot& plot, const std::vector<TObject*>& objects) {
+    if (objects.size() != m_files.size()) {
+      LOG(ERROR) << objects.size() << " object(s) given for plot '" << plot.name << "', but " << m_files.size() << " file(s) are configured";
+      return nullptr;
+    }
+
+    for (size_t i = 0; i < m_files.size(); i++) {
+      if (! objects[i]) {
+        LOG(ERROR) << "no object given for file '" << m_files[i].path << "' in plot '" << plot.name << "'";
+        return nullptr;
+      }
+
+      m_files[i].object = objects[i];
+    }
+
+    if (! drawPlot(plot))
+      return nullptr;
+
+    return &m_currentLayout->getCanvas();
+  }
+}
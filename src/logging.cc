@@ -0,0 +1,129 @@
+#include <logging.h>
+#include <utilities.h>
+
+#include <iostream>
+
+namespace plotIt {
+
+  // Size of the text buffer before it's written to stdout
+  static const size_t BUFFER_SIZE = 64 * 1024;
+
+  static const char* levelName(LogLevel level) {
+    switch (level) {
+      case LogLevel::ERROR:
+        return "error";
+      case LogLevel::WARNING:
+        return "warning";
+      case LogLevel::NOTICE:
+        return "notice";
+      case LogLevel::INFO:
+        return "info";
+      case LogLevel::DEBUG:
+        return "debug";
+    }
+
+    return "";
+  }
+
+  Logger& Logger::get() {
+    static Logger s_logger;
+    return s_logger;
+  }
+
+  Logger::Logger():
+    m_start(std::chrono::steady_clock::now()) {
+      m_buffer.reserve(BUFFER_SIZE);
+    }
+
+  Logger::~Logger() {
+    flush();
+  }
+
+  void Logger::setJSONOutput(const std::string& path) {
+    m_json.reset(new std::ofstream(path.c_str()));
+    m_json_enabled = true;
+  }
+
+  void Logger::log(LogLevel level, const std::string& message) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (level == LogLevel::ERROR)
+      m_errors += "Error: " + message + '\n';
+    else if (level == LogLevel::WARNING)
+      m_errors += "Warning: " + message + '\n';
+    else {
+      m_buffer += message;
+      m_buffer += '\n';
+    }
+
+    if (m_json_enabled) {
+      double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+      std::ostringstream entry;
+      entry << "{\"time\": " << time << ", \"level\": \"" << levelName(level) << "\", \"plot\": \"" << escapeJSON(m_context) << "\", \"message\": \"" << escapeJSON(message) << "\"}\n";
+      m_json_buffer += entry.str();
+    }
+
+    // Warnings and errors are written immediately, next to the messages of the same
+    // plot, and in case we crash just after
+    if (m_errors.length() || m_buffer.length() >= BUFFER_SIZE || m_json_buffer.length() >= BUFFER_SIZE)
+      flushLocked();
+  }
+
+  void Logger::append(const std::string& text, const std::string& errors, const std::string& json) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_buffer += text;
+    m_errors += errors;
+    if (m_json_enabled)
+      m_json_buffer += json;
+
+    if (m_errors.length() || m_buffer.length() >= BUFFER_SIZE || m_json_buffer.length() >= BUFFER_SIZE)
+      flushLocked();
+  }
+
+  void Logger::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    flushLocked();
+  }
+
+  void Logger::setStatus(const std::string& status, bool keep) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Erase the previous status line
+    std::cerr << "\r\033[K" << status << (keep ? "\n" : "") << std::flush;
+    m_status = keep ? "" : status;
+  }
+
+  void Logger::flushLocked() {
+    if (m_forwarder) {
+      if (m_buffer.length() || m_errors.length() || m_json_buffer.length())
+        m_forwarder(m_buffer, m_errors, m_json_buffer);
+    } else {
+      bool hideStatus = m_status.length() && (m_buffer.length() || m_errors.length());
+      if (hideStatus)
+        std::cerr << "\r\033[K" << std::flush;
+
+      // The buffered messages came first
+      if (m_buffer.length())
+        std::cout.write(m_buffer.data(), m_buffer.length());
+      std::cout.flush();
+
+      if (m_errors.length()) {
+        std::cerr.write(m_errors.data(), m_errors.length());
+        std::cerr.flush();
+      }
+
+      if (hideStatus)
+        std::cerr << m_status << std::flush;
+
+      if (m_json.get() && m_json_buffer.length()) {
+        m_json->write(m_json_buffer.data(), m_json_buffer.length());
+        m_json->flush();
+      }
+    }
+
+    m_buffer.clear();
+    m_errors.clear();
+    m_json_buffer.clear();
+  }
+}
@@ -0,0 +1,197 @@
+#include "plotIt.h"
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "tclap/CmdLine.h"
+
+#include <boost/filesystem.hpp>
+
+#include <InputStore.h>
+#include <logging.h>
+
+namespace fs = boost::filesystem;
+
+int main(int argc, char** argv) {
+
+  try {
+
+    TCLAP::CmdLine cmd("Plot histograms", ' ', "0.1");
+
+    TCLAP::ValueArg<std::string> outputFolderArg("o", "output-folder", "output folder", true, "", "string", cmd);
+
+    TCLAP::SwitchArg ignoreScaleArg("", "ignore-scales", "Ignore any scales present in the configuration file", cmd, false);
+
+    TCLAP::ValueArg<uint16_t> workersArg("j", "workers", "Load all inputs once, then fork this number of worker processes to draw the plots", false, 1, "int", cmd);
+
+    TCLAP::ValueArg<std::string> shardArg("", "shard", "Only draw the plots of shard i out of N, formatted as 'i/N' with 0 <= i < N", false, "", "string", cmd);
+
+    TCLAP::SwitchArg mergeArg("", "merge", "Merge the summaries written by all the shards in the output folder, without drawing anything", cmd, false);
+
+    TCLAP::ValueArg<std::string> compareWithArg("", "compare-with", "Compare every object with the same object in the files of this other root, write a ranked report, and only draw the incompatible plots", false, "", "string", cmd);
+
+    TCLAP::ValueArg<float> compareThresholdArg("", "compare-threshold", "With --compare-with, draw the plots where a file has a chi2 probability below this value", false, 0.01, "float", cmd);
+
+    TCLAP::ValueArg<std::string> inputCacheArg("", "input-cache", "Copy input files into this local directory on first access, and read them from there", false, "", "string", cmd);
+
+    TCLAP::ValueArg<float> inputCacheSizeArg("", "input-cache-size", "Maximal size of the input cache, in GB", false, 50, "float", cmd);
+
+    TCLAP::ValueArg<std::string> treeCacheArg("", "tree-cache", "Keep the histograms filled from trees in this directory, and reuse them while the trees and plots are unchanged", false, "", "string", cmd);
+
+    TCLAP::ValueArg<std::string> snapshotCacheArg("", "snapshot-cache", "Keep binary snapshots of the histograms read from the inputs in this directory, and read them from there while the inputs are unchanged", false, "", "string", cmd);
+
+    std::vector<std::string> exportFormats = {"root", "json"};
+    TCLAP::ValuesConstraint<std::string> exportFormatsConstraint(exportFormats);
+    TCLAP::ValueArg<std::string> exportArg("", "export-data", "Export the computed histograms (scaled samples, MC sums, uncertainty bands, ratio and fit) into one ROOT file for the run, or one JSON file per plot", false, "", &exportFormatsConstraint, cmd);
+
+    TCLAP::ValueArg<std::string> configCacheArg("", "config-cache", "Directory where the fully resolved configuration is cached, and reloaded from as long as no YAML file changed", false, "", "string", cmd);
+
+    TCLAP::ValueArg<uint16_t> threadsArg("t", "threads", "Number of threads used to check inputs, sum histograms, and prepare the next plots while drawing", false, 1, "int", cmd);
+
+    TCLAP::SwitchArg checkBinningArg("", "check-binning", "Before plotting, also check that every object has the same binning in all the files. This reads every object", cmd, false);
+
+    TCLAP::SwitchArg progressArg("", "progress", "Show the progress of the run (plots done, throughput, bytes read, memory and time left) as a status line on the terminal. Best used with --quiet", cmd, false);
+
+    TCLAP::ValueArg<std::string> progressFileArg("", "progress-file", "Rewrite the progress of the run, every second, as JSON into this file", false, "", "string", cmd);
+
+    TCLAP::SwitchArg quietArg("q", "quiet", "Only print warnings, errors and the final summary", cmd, false);
+
+    TCLAP::SwitchArg verboseArg("v", "verbose", "Print debugging informations", cmd, false);
+
+    TCLAP::ValueArg<std::string> logJSONArg("", "log-json", "Also write log messages, as JSON lines, into this file", false, "", "string", cmd);
+
+    TCLAP::UnlabeledMultiArg<std::string> configFileArg("configFile", "configuration files. With more than one, each configuration is drawn in its own subfolder of the output folder, and inputs are read only once", true, "string", cmd);
+
+    cmd.parse(argc, argv);
+
+    //bool isData = dataArg.isSet();
+
+    if (quietArg.getValue())
+      plotIt::Logger::get().setLevel(plotIt::LogLevel::NOTICE);
+    else if (verboseArg.getValue())
+      plotIt::Logger::get().setLevel(plotIt::LogLevel::DEBUG);
+
+    if (logJSONArg.isSet())
+      plotIt::Logger::get().setJSONOutput(logJSONArg.getValue());
+
+    fs::path outputPath(outputFolderArg.getValue());
+
+    if (! fs::exists(outputPath)) {
+      LOG(ERROR) << "output path " << outputPath << " does not exist";
+      return 1;
+    }
+
+    uint32_t shard_index = 0, shard_count = 1;
+    if (shardArg.isSet()) {
+      char separator;
+      std::istringstream ss(shardArg.getValue());
+      if (! (ss >> shard_index >> separator >> shard_count) || separator != '/' || shard_count == 0 || shard_index >= shard_count) {
+        LOG(ERROR) << "invalid shard '" << shardArg.getValue() << "', expected 'i/N' with 0 <= i < N";
+        return 1;
+      }
+    }
+
+    // With several configurations, all of them share the opened inputs and the objects read
+    const std::vector<std::string>& configFiles = configFileArg.getValue();
+    std::shared_ptr<plotIt::InputStore> inputs;
+    if (configFiles.size() > 1)
+      inputs = std::make_shared<plotIt::InputStore>();
+
+    // Each configuration has its own output subfolder, named after the configuration
+    // file, or after its folder and itself if several files have the same name
+    std::vector<std::string> subfolders;
+    if (configFiles.size() > 1) {
+      std::map<std::string, size_t> stems;
+      for (const std::string& configFile: configFiles)
+        stems[fs::path(configFile).stem().string()]++;
+
+      std::set<std::string> unique;
+      for (const std::string& configFile: configFiles) {
+        std::string subfolder = fs::path(configFile).stem().string();
+        if (stems[subfolder] > 1) {
+          boost::system::error_code error;
+          fs::path path = fs::canonical(configFile, error);
+          if (error)
+            path = fs::absolute(configFile);
+
+          subfolder = path.parent_path().filename().string() + "_" + subfolder;
+        }
+
+        if (! unique.insert(subfolder).second) {
+          LOG(ERROR) << "configuration '" << configFile << "' would share its output folder '" << subfolder << "' with another configuration";
+          return 1;
+        }
+
+        subfolders.push_back(subfolder);
+      }
+    }
+
+    // Objects of the shared store are freed once no remaining configuration uses their file
+    std::vector<std::set<std::string>> configInputs;
+    if (inputs.get()) {
+      for (const std::string& configFile: configFiles) {
+        plotIt::plotIt p(outputPath, configFile, configCacheArg.getValue());
+        configInputs.push_back(p.getInputFiles());
+      }
+    }
+
+    bool success = true;
+    for (size_t c = 0; c < configFiles.size(); c++) {
+      const std::string& configFile = configFiles[c];
+
+      fs::path configOutputPath = outputPath;
+      if (configFiles.size() > 1) {
+        configOutputPath /= subfolders[c];
+        fs::create_directories(configOutputPath);
+
+        LOG(NOTICE) << "Configuration '" << configFile << "', output folder " << configOutputPath;
+      }
+
+      plotIt::plotIt p(configOutputPath, configFile, configCacheArg.getValue());
+      p.getConfigurationForEditing().ignore_scales = ignoreScaleArg.getValue();
+      p.getConfigurationForEditing().workers = workersArg.getValue();
+      p.getConfigurationForEditing().threads = threadsArg.getValue();
+      p.getConfigurationForEditing().check_binning = checkBinningArg.getValue();
+      p.getConfigurationForEditing().export_format = exportArg.getValue();
+      p.getConfigurationForEditing().input_cache = inputCacheArg.getValue();
+      p.getConfigurationForEditing().input_cache_size = inputCacheSizeArg.getValue() * 1024 * 1024 * 1024;
+      p.getConfigurationForEditing().tree_cache = treeCacheArg.getValue();
+      p.getConfigurationForEditing().snapshot_cache = snapshotCacheArg.getValue();
+      p.getConfigurationForEditing().progress = progressArg.getValue();
+      p.getConfigurationForEditing().progress_file = progressFileArg.getValue();
+      p.getConfigurationForEditing().compare_with = compareWithArg.getValue();
+      p.getConfigurationForEditing().compare_threshold = compareThresholdArg.getValue();
+      p.getConfigurationForEditing().shard_index = shard_index;
+      p.getConfigurationForEditing().shard_count = shard_count;
+
+      if (inputs.get())
+        p.setInputStore(inputs);
+
+      if (mergeArg.getValue())
+        success &= p.mergeShards();
+      else if (compareWithArg.isSet())
+        success &= p.compareAll();
+      else
+        success &= p.plotAll();
+
+      if (inputs.get()) {
+        std::set<std::string> needed;
+        for (size_t next = c + 1; next < configFiles.size(); next++)
+          needed.insert(configInputs[next].begin(), configInputs[next].end());
+
+        p.releaseInputs(needed);
+      }
+    }
+
+    if (! success)
+      return 1;
+
+  } catch (TCLAP::ArgException &e) {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include "plotIt.h"
+
+#include <TH1.h>
+
+#include <deque>
+#include <future>
+#include <map>
+
+#include <InputStore.h>
+#include <logging.h>
+#include <plotter.h>
+#include <utilities.h>
+
+/**
+ * Pipelined plotting. Objects are read on the main thread, the computations
+ * (scaling, sums, uncertainty bands, ratio) of the next plots run on other
+ * threads meanwhile, and plots are drawn and saved in order on the main thread,
+ * since ROOT graphics are not thread-safe.
+ **/
+
+namespace plotIt {
+
+  struct PipelinedPlot {
+    std::shared_ptr<plotter> prepared_by;
+    std::shared_ptr<PreparedPlot> prepared;
+    std::future<void> done;
+  };
+
+  /**
+   * Read the objects of 'plot' into a new prepared plot, created by the plotter
+   * supporting them. Return nullptr if an object is missing
+   **/
+  std::shared_ptr<PreparedPlot> plotIt::loadPreparedPlot(const Plot& plot, std::shared_ptr<plotter>& prepared_by) {
+    std::vector<PreparedFile> files(m_files.size());
+    std::vector<std::shared_ptr<TObject>> objects;
+
+    // Objects of a shared store may be needed by other configurations, keep them there
+    bool keepInStore = m_inputs.use_count() > 1;
+
+    auto load = [&](const std::string& path, const std::string& name) -> TObject* {
+      if (keepInStore)
+        return getStoredObject(path, name, objects);
+
+      std::shared_ptr<TObject> object = m_inputs->takeObject(getInputPath(path), name);
+      if (object.get())
+        objects.push_back(object);
+
+      return object.get();
+    };
+
+    for (size_t i = 0; i < m_files.size(); i++) {
+      files[i].object = load(m_files[i].path, plot.name);
+      if (! files[i].object) {
+        LOG(ERROR) << "object '" << plot.name << "' inheriting from '" << plot.inherits_from << "' not found in file '" << m_files[i].path << "'";
+        return nullptr;
+      }
+
+      for (Systematic& syst: m_files[i].systematics) {
+        files[i].systematics.push_back(load(syst.path, syst.getObjectName(plot.name)));
+        files[i].systematics_summary.push_back(Summary());
+      }
+    }
+
+    prepared_by.reset();
+    for (auto& p: m_plotters) {
+      if (p->supports(*files[0].object)) {
+        prepared_by = p;
+        break;
+      }
+    }
+
+    if (! prepared_by.get())
+      return nullptr;
+
+    std::shared_ptr<PreparedPlot> prepared = prepared_by->createPreparedPlot();
+    prepared->files.swap(files);
+    prepared->objects.swap(objects);
+
+    return prepared;
+  }
+
+  uint32_t plotIt::plotPipelined(std::vector<Plot>& plots) {
+    // With ROOT 5, plots are still prepared ahead, but on the main thread
+    uint16_t threads = enableThreadSafety(m_config.threads);
+    std::launch policy = (threads > 1) ? std::launch::async : std::launch::deferred;
+
+    // Objects created while preparing must not end up in the current directory,
+    // which is shared by all threads. Restored at the end, for other configurations
+    bool addDirectory = TH1::AddDirectoryStatus();
+    TH1::AddDirectory(kFALSE);
+
+    createInputStore();
+
+    uint32_t failed = 0;
+    size_t next = 0;
+    std::deque<PipelinedPlot> pipeline;
+
+    // Buffers of each plotter, for each slot of the pipeline. At most one plot
+    // per slot is prepared at a time: plot i uses slot i % threads, and the
+    // plot which used the slot before is already drawn
+    std::vector<std::map<plotter*, std::shared_ptr<PrepareBuffers>>> slots(m_config.threads);
+
+    for (Plot& plot: plots) {
+      // Keep up to one plot per thread in preparation
+      while (next < plots.size() && pipeline.size() < m_config.threads) {
+        std::map<plotter*, std::shared_ptr<PrepareBuffers>>& slot = slots[next % m_config.threads];
+        Plot& to_prepare = plots[next++];
+        Logger::get().setContext(to_prepare.name);
+
+        PipelinedPlot entry;
+        entry.prepared = loadPreparedPlot(to_prepare, entry.prepared_by);
+        if (entry.prepared.get()) {
+          std::shared_ptr<PrepareBuffers>& buffers = slot[entry.prepared_by.get()];
+          if (! buffers.get())
+            buffers = entry.prepared_by->createPrepareBuffers();
+
+          std::shared_ptr<plotter> prepared_by = entry.prepared_by;
+          std::shared_ptr<PreparedPlot> prepared = entry.prepared;
+          entry.done = std::async(policy, [prepared_by, prepared, buffers, &to_prepare]() {
+              // Already on one of the pipeline threads
+              prepared_by->prepare(to_prepare, *prepared, *buffers, 1);
+            });
+        }
+
+        pipeline.push_back(std::move(entry));
+      }
+
+      PipelinedPlot entry = std::move(pipeline.front());
+      pipeline.pop_front();
+
+      reportPlotStarted(plot.name);
+
+      bool success = false;
+      if (entry.prepared.get()) {
+        entry.done.get();
+        entry.prepared->install(m_files);
+
+        success = drawPlot(plot, entry.prepared_by.get(), entry.prepared.get());
+      }
+
+      if (! success) {
+        failed++;
+
+        PlotResult result;
+        result.name = plot.name;
+        m_results.push_back(result);
+      }
+
+      reportPlotDone(success);
+    }
+
+    TH1::AddDirectory(addDirectory);
+
+    return failed;
+  }
+}
@@ -3,29 +3,36 @@
 // For fnmatch()
 #include <fnmatch.h>
 
+// For getpid()
+#include <unistd.h>
+
 #include <TList.h>
 #include <TCollection.h>
 #include <TCanvas.h>
 #include <TError.h>
 #include <TFile.h>
 #include <TKey.h>
+#include <TClass.h>
 #include <TLatex.h>
 #include <TLegend.h>
 #include <TLegendEntry.h>
-#include <TPaveText.h>
 #include <TColor.h>
 
 #include <vector>
 #include <map>
 #include <fstream>
 
-#include "tclap/CmdLine.h"
-
 #include <boost/regex.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
+#include <CanvasLayout.h>
+#include <InputCache.h>
+#include <InputStore.h>
+#include <Progress.h>
+#include <allocations.h>
+#include <logging.h>
 #include <plotters.h>
 #include <utilities.h>
 
@@ -45,45 +52,113 @@ static Dummy foo;
 
 namespace plotIt {
 
-  plotIt::plotIt(const fs::path& outputPath, const std::string& configFile):
+  plotIt::plotIt(const fs::path& outputPath, const std::string& configFile, const std::string& configCacheDirectory/* = ""*/):
     m_outputPath(outputPath) {
 
-      createPlotters(*this);
+      createPlotters(*this, m_plotters);
 
       gErrorIgnoreLevel = kError;
       m_style.reset(createStyle());
-      parseConfigurationFile(configFile);
+
+      if (configCacheDirectory.empty()) {
+        parseConfigurationFile(configFile);
+        return;
+      }
+
+      fs::path cachePath = getConfigurationCachePath(configCacheDirectory, configFile);
+      if (cachePath.empty()) {
+        parseConfigurationFile(configFile);
+        return;
+      }
+
+      if (! loadConfigurationCache(cachePath)) {
+        parseConfigurationFile(configFile);
+        writeConfigurationCache(cachePath);
+      }
     }
 
-  int16_t plotIt::loadColor(const YAML::Node& node) {
-    std::string value = node.as<std::string>();
-    if (value.length() > 1 && value[0] == '#' && ((value.length() == 7) || (value.length() == 9))) {
-      // RGB Color
-      std::string c = value.substr(1);
-      // Convert to int with hexadecimal base
-      uint32_t color = 0;
-      std::stringstream ss;
-      ss << std::hex << c;
-      ss >> color;
+  /**
+   * Create plotIt without configuration file, for use as a library. Files
+   * without plot style get the default style of their type
+   **/
+  plotIt::plotIt(const fs::path& outputPath, const Configuration& config, const std::vector<File>& files, const std::map<std::string, Group>& groups/* = std::map<std::string, Group>()*/):
+    m_outputPath(outputPath), m_files(files), m_groups(groups), m_config(config) {
+
+      createPlotters(*this, m_plotters);
+
+      gErrorIgnoreLevel = kError;
+      m_style.reset(createStyle());
+
+      for (auto& group: m_groups) {
+        if (! group.second.plot_style.get()) {
+          group.second.plot_style = std::make_shared<PlotStyle>();
+          group.second.plot_style->loadDefaults(MC);
+        }
+      }
 
-      float a = 1;
-      if (color > 0xffffff) {
-        a = (color >> 24) / 255.0;
+      for (File& file: m_files) {
+        if (file.group.empty() && ! file.plot_style.get()) {
+          file.plot_style = std::make_shared<PlotStyle>();
+          file.plot_style->loadDefaults(file.type);
+        }
       }
 
-      float r = ((color >> 16) & 0xff) / 255.0;
-      float g = ((color >> 8) & 0xff) / 255.0;
-      float b = ((color) & 0xff) / 255.0;
+      std::sort(m_files.begin(), m_files.end(), [](const File& a, const File& b) {
+        return a.order < b.order;
+       });
+
+      m_legend.position.x1 = 0.6;
+      m_legend.position.y1 = 0.6;
 
-      // Create new color
-      m_temporaryObjectsRuntime.push_back(std::make_shared<TColor>(m_colorIndex++, r, g, b, "", a));
+      m_legend.position.x2 = 0.9;
+      m_legend.position.y2 = 0.9;
 
-      return m_colorIndex - 1;
+      resolvePlotStyles();
+      parseLumiLabel();
+    }
+
+  int16_t plotIt::loadColor(const YAML::Node& node) {
+    std::string value = node.as<std::string>();
+    if (value.length() > 1 && value[0] == '#' && ((value.length() == 7) || (value.length() == 9))) {
+      return createColor(value);
     } else {
       return node.as<int16_t>();
     }
   }
 
+  /**
+   * Create a new ROOT color from a '#rrggbb' or '#aarrggbb' string.
+   * Colors are interned, the same string always gives the same index
+   **/
+  int16_t plotIt::createColor(const std::string& value) {
+    auto it = m_colors.find(value);
+    if (it != m_colors.end())
+      return it->second;
+
+    // RGB Color
+    std::string c = value.substr(1);
+    // Convert to int with hexadecimal base
+    uint32_t color = 0;
+    std::stringstream ss;
+    ss << std::hex << c;
+    ss >> color;
+
+    float a = 1;
+    if (color > 0xffffff) {
+      a = (color >> 24) / 255.0;
+    }
+
+    float r = ((color >> 16) & 0xff) / 255.0;
+    float g = ((color >> 8) & 0xff) / 255.0;
+    float b = ((color) & 0xff) / 255.0;
+
+    // Create new color
+    m_temporaryObjectsRuntime.push_back(std::make_shared<TColor>(m_colorIndex++, r, g, b, "", a));
+    m_colors[value] = m_colorIndex - 1;
+
+    return m_colorIndex - 1;
+  }
+
   void plotIt::parseIncludes(YAML::Node& node) {
 
     if (! node["include"])
@@ -93,6 +168,7 @@ namespace plotIt {
     node.remove("include");
 
     for (std::string& file: files) {
+      m_configurationSources.push_back(file);
       YAML::Node root = YAML::LoadFile(file);
 
       for (YAML::const_iterator it = root.begin(); it != root.end(); ++it) {
@@ -104,6 +180,7 @@ namespace plotIt {
   }
 
   void plotIt::parseConfigurationFile(const std::string& file) {
+    m_configurationSources.push_back(file);
     YAML::Node f = YAML::LoadFile(file);
 
     if (! f["files"]) {
@@ -249,6 +326,9 @@ namespace plotIt {
       else
         file.generated_events = 1.;
 
+      if (node["tree"])
+        file.tree = node["tree"].as<std::string>();
+
       file.order = std::numeric_limits<int16_t>::min();
       if (node["order"])
         file.order = node["order"].as<int16_t>();
@@ -263,27 +343,41 @@ namespace plotIt {
 
       if (node["systematics"]) {
 
-        const auto& addSystematic = [&root, &file](const std::string& systematics) {
+        const auto& addSystematic = [&root, &file](const std::string& systematics, const std::string& name) {
           fs::path path = fs::path(systematics);
           std::string fullPath = (root / path).string();
 
           if (boost::filesystem::exists(fullPath)) {
             Systematic s;
             s.path = fullPath;
+            s.name = name;
 
             file.systematics.push_back(s);
           } else {
-            std::cerr << "Warning: systematics file '" << systematics << "' not found." << std::endl;
+            LOG(WARNING) << "systematics file '" << systematics << "' not found.";
+          }
+        };
+
+        // A systematic is either a file, or a map with the name of the variation, stored
+        // in the 'syst/<name>/' directory of the nominal file, or of 'file' if present
+        const auto& parseSystematic = [&](const YAML::Node& syst) {
+          if (syst.IsMap()) {
+            if (syst["file"])
+              addSystematic(syst["file"].as<std::string>(), syst["name"].as<std::string>());
+            else
+              file.systematics.push_back({file.path, syst["name"].as<std::string>(), nullptr, Summary()});
+          } else {
+            addSystematic(syst.as<std::string>(), "");
           }
         };
 
         const YAML::Node& syst = node["systematics"];
         if (syst.IsSequence()) {
           for (const auto& it: syst) {
-            addSystematic(it.as<std::string>());
+            parseSystematic(it);
           }
         } else {
-          addSystematic(syst.as<std::string>());
+          parseSystematic(syst);
         }
       }
 
@@ -299,6 +393,8 @@ namespace plotIt {
       return a.order < b.order;
      });
 
+    resolvePlotStyles();
+
     if (! f["plots"]) {
       throw YAML::ParserException(YAML::Mark::null_mark(), "You must specify at least one plot in your configuration file");
     }
@@ -340,6 +436,18 @@ namespace plotIt {
       else
         plot.show_ratio = false;
 
+      if (node["ratio-type"]) {
+        std::string type = node["ratio-type"].as<std::string>();
+        if (type == "ratio")
+          plot.ratio_type = RATIO;
+        else if (type == "pull")
+          plot.ratio_type = PULL;
+        else if (type == "significance")
+          plot.ratio_type = SIGNIFICANCE;
+        else
+          throw YAML::ParserException(YAML::Mark::null_mark(), "Plot '" + plot.name + "': unknown ratio-type '" + type + "'. Valid types are 'ratio', 'pull' and 'significance'");
+      }
+
       if (node["fit-ratio"])
         plot.fit_ratio = node["fit-ratio"].as<bool>();
 
@@ -373,6 +481,21 @@ namespace plotIt {
       else
         plot.rebin = 1;
 
+      if (node["variable"])
+        plot.variable = node["variable"].as<std::string>();
+
+      if (node["cut"])
+        plot.cut = node["cut"].as<std::string>();
+
+      if (node["binning"]) {
+        plot.binning = node["binning"].as<std::vector<float>>();
+        if (plot.binning.size() != 3)
+          throw YAML::ParserException(YAML::Mark::null_mark(), "'binning' of plot '" + plot.name + "' must be [number of bins, minimum, maximum]");
+      }
+
+      if (! plot.variable.empty() && plot.binning.empty())
+        throw YAML::ParserException(YAML::Mark::null_mark(), "plot '" + plot.name + "' has a variable, but no binning");
+
       if (node["labels"]) {
         YAML::Node labels = node["labels"];
         plot.labels = parseLabelsNode(labels);
@@ -384,6 +507,13 @@ namespace plotIt {
       if (node["legend-position"])
         plot.legend_position = node["legend-position"].as<Position>();
 
+      if (node["signal-scan"]) {
+        if (node["signal-scan"].IsSequence())
+          plot.signal_scan = node["signal-scan"].as<std::vector<std::string>>();
+        else
+          plot.signal_scan.push_back(node["signal-scan"].as<std::string>());
+      }
+
       m_plots.push_back(plot);
     }
 
@@ -402,6 +532,19 @@ namespace plotIt {
     parseLumiLabel();
   }
 
+  /**
+   * Resolve plot styles once, so that no lookup is needed when plotting
+   **/
+  void plotIt::resolvePlotStyles() {
+    for (File& file: m_files) {
+      if (file.group.length() && m_groups.count(file.group)) {
+        file.resolved_plot_style = m_groups[file.group].plot_style;
+      } else {
+        file.resolved_plot_style = file.plot_style;
+      }
+    }
+  }
+
   void plotIt::parseLumiLabel() {
 
     m_config.lumi_label_parsed = m_config.lumi_label;
@@ -415,8 +558,16 @@ namespace plotIt {
     boost::algorithm::replace_all(m_config.lumi_label_parsed, "%lumi%", lumiStr);
   }
 
-  void plotIt::addToLegend(TLegend& legend, Type type) {
-    for (File& file: m_files) {
+  /**
+   * Add the files of type 'type' to the legend. Points of the signal scan are
+   * skipped, except 'scanPoint'
+   **/
+  void plotIt::addToLegend(TLegend& legend, Type type, int64_t scanPoint/* = -1*/) {
+    for (size_t i = 0; i < m_files.size(); i++) {
+      File& file = m_files[i];
+      if (isScanPoint(i) && (int64_t) i != scanPoint)
+        continue;
+
       if (file.type == type) {
         if (file.group.length() > 0 && m_groups.count(file.group) &&
             !m_groups[file.group].added && m_groups[file.group].plot_style->legend.length() > 0) {
@@ -429,39 +580,104 @@ namespace plotIt {
     }
   }
 
+  void plotIt::findScanPoints(const Plot& plot) {
+    m_scanPoints.assign(m_files.size(), false);
+
+    for (size_t i = 0; i < m_files.size(); i++) {
+      if (m_files[i].type != SIGNAL)
+        continue;
+
+      std::string name = fs::path(m_files[i].path).filename().string();
+      for (const std::string& pattern: plot.signal_scan) {
+        if (fnmatch(pattern.c_str(), name.c_str(), 0) == 0) {
+          m_scanPoints[i] = true;
+          break;
+        }
+      }
+    }
+  }
+
   bool plotIt::plot(Plot& plot) {
-    std::cout << "Plotting '" << plot.name << "'" << std::endl;
+    Logger::get().setContext(plot.name);
 
-    bool hasMC = false;
-    bool hasData = false;
-    bool hasSignal = false;
-    bool hasLegend = false;
     // Open all files, and find histogram in each
     for (File& file: m_files) {
       if (! loadObject(file, plot)) {
         return false;
       }
+    }
+
+    return drawPlot(plot);
+  }
+
+  /**
+   * Canvas, pads and decorations for plots with or without ratio, built on first use
+   * and reused by all the plots. It becomes the layout of the current plot
+   **/
+  CanvasLayout& plotIt::getCanvasLayout(bool ratio) {
+    std::shared_ptr<CanvasLayout>& layout = ratio ? m_ratioLayout : m_singleLayout;
+    if (! layout.get())
+      layout = std::make_shared<CanvasLayout>(m_config, ratio);
+
+    m_currentLayout = layout.get();
+
+    return *layout;
+  }
+
+  /**
+   * Draw and save 'plot', whose objects are loaded in the files. If 'prepared' is
+   * set, it was already computed by 'prepared_by' and is only drawn
+   **/
+  bool plotIt::drawPlot(Plot& plot, plotter* prepared_by, PreparedPlot* prepared) {
+    Logger::get().setContext(plot.name);
+    LOG(INFO) << "Plotting '" << plot.name << "'";
+
+    // Leftovers of a previous failed plot
+    m_exportedObjects.clear();
 
+    bool hasMC = false;
+    bool hasData = false;
+    bool hasSignal = false;
+    bool hasLegend = false;
+    for (File& file: m_files) {
       hasLegend |= getPlotStyle(file)->legend.length() > 0;
       hasData |= file.type == DATA;
       hasMC |= file.type == MC;
       hasSignal |= file.type == SIGNAL;
     }
 
-    // Create canvas
-    TCanvas c("canvas", "canvas", m_config.width, m_config.height);
+    // Scanned signals are drawn below, one at a time over what the plotter draws
+    findScanPoints(plot);
 
-    bool success = ::plotIt::plot(m_files[0], c, plot);
+    std::vector<size_t> scanPoints;
+    for (size_t i = 0; i < m_files.size(); i++) {
+      if (isScanPoint(i))
+        scanPoints.push_back(i);
+    }
+
+    if (! plot.signal_scan.empty() && scanPoints.empty())
+      LOG(WARNING) << "no signal file matches the signal scan of plot '" << plot.name << "'";
+
+    uint64_t allocations = getAllocationsCount();
+    bool success = false;
+    if (prepared)
+      success = prepared_by->draw(plot, *prepared);
+    else
+      success = ::plotIt::plot(m_plotters, m_files[0], plot);
+
+    if (isAllocationsCountEnabled()) {
+      LOG(INFO) << "Allocations while drawing, ROOT included: " << getAllocationsCount() - allocations;
+    }
 
     auto printSummary = [&](Type type) {
       float sum_n_events = 0;
       float sum_n_events_error = 0;
 
-      printf("%50s%18s ± %11s%15s%19s  ± %20s\n", " ", "N", u8"ΔN", " ", u8"ε", u8"Δε");
+      LOG(INFO) << boost::format("%50s%18s ± %11s%15s%19s  ± %20s") % " " % "N" % u8"ΔN" % " " % u8"ε" % u8"Δε";
       for (File& file: m_files) {
         if (file.type == type) {
           fs::path path(file.path);
-          printf("%50s%18.2f ± %10.2f%15s%18.5f%% ± %18.5f%%\n", path.stem().c_str(), file.summary.n_events, file.summary.n_events_error, " ", file.summary.efficiency * 100, file.summary.efficiency_error * 100);
+          LOG(INFO) << boost::format("%50s%18.2f ± %10.2f%15s%18.5f%% ± %18.5f%%") % path.stem().string() % file.summary.n_events % file.summary.n_events_error % " " % (file.summary.efficiency * 100) % (file.summary.efficiency_error * 100);
 
           sum_n_events += file.summary.n_events;
           sum_n_events_error += file.summary.n_events_error * file.summary.n_events_error;
@@ -471,125 +687,111 @@ namespace plotIt {
       if (sum_n_events) {
         float systematics = 0;
         if (type == MC && m_config.luminosity_error_percent > 0) {
-          std::cout << "------------------------------------------" << std::endl;
-          std::cout << "Systematic uncertainties" << std::endl;
-          printf("%50s%18s ± %10.2f\n", "Luminosity", " ", sum_n_events * m_config.luminosity_error_percent);
+          LOG(INFO) << "------------------------------------------";
+          LOG(INFO) << "Systematic uncertainties";
+          LOG(INFO) << boost::format("%50s%18s ± %10.2f") % "Luminosity" % " " % (sum_n_events * m_config.luminosity_error_percent);
           systematics = sum_n_events * m_config.luminosity_error_percent;
         }
         for (File& file: m_files) {
           if (file.type == type) {
             for (Systematic& s: file.systematics) {
-              fs::path path(s.path);
-              printf("%50s%18s ± %10.2f\n", path.stem().c_str(), " ", s.summary.n_events_error);
+              std::string name = s.name.empty() ? fs::path(s.path).stem().string() : s.name;
+              LOG(INFO) << boost::format("%50s%18s ± %10.2f") % name % " " % s.summary.n_events_error;
 
               sum_n_events_error += s.summary.n_events_error * s.summary.n_events_error;
             }
           }
         }
-        std::cout << "------------------------------------------" << std::endl;
-        printf("%50s%18.2f ± %10.2f\n", " ", sum_n_events, sqrt(sum_n_events_error + systematics * systematics));
+        LOG(INFO) << "------------------------------------------";
+        LOG(INFO) << boost::format("%50s%18.2f ± %10.2f") % " " % sum_n_events % sqrt(sum_n_events_error + systematics * systematics);
       }
     };
 
-    if (! success)
+    if (! success) {
+      m_scanPoints.clear();
       return false;
+    }
 
-    std::cout << "Summary: " << std::endl;
+    // Don't even loop over the files if the summary is not printed
+    if (Logger::get().isEnabled(LogLevel::INFO)) {
+      LOG(INFO) << "Summary: ";
 
-    if (hasData) {
-     std::cout << "Data" << std::endl;
-     printSummary(DATA);
-     std::cout << std::endl;
-    }
+      if (hasData) {
+        LOG(INFO) << "Data";
+        printSummary(DATA);
+        LOG(INFO) << "";
+      }
 
-    if (hasMC) {
-     std::cout << "MC: " << std::endl;
-     printSummary(MC);
-     std::cout << std::endl;
-    }
+      if (hasMC) {
+        LOG(INFO) << "MC: ";
+        printSummary(MC);
+        LOG(INFO) << "";
+      }
 
-    if (hasSignal) {
-     std::cout << std::endl << "Signal: " << std::endl;
-     printSummary(SIGNAL);
-     std::cout << std::endl;
+      if (hasSignal) {
+        LOG(INFO) << "";
+        LOG(INFO) << "Signal: ";
+        printSummary(SIGNAL);
+        LOG(INFO) << "";
+      }
     }
 
-    if (plot.log_y)
-      c.SetLogy();
+    // The plotter chose the layout, and left its main pad as the current one
+    CanvasLayout& layout = *m_currentLayout;
+    TCanvas& c = layout.getCanvas();
 
     Position legend_position = m_legend.position;
     if (!plot.legend_position.empty())
       legend_position = plot.legend_position;
 
     // Build legend
-    TLegend legend(legend_position.x1, legend_position.y1, legend_position.x2, legend_position.y2);
-    legend.SetTextFont(43);
-    legend.SetFillStyle(0);
-    legend.SetBorderSize(0);
-
-    addToLegend(legend, MC);
-    addToLegend(legend, SIGNAL);
-    addToLegend(legend, DATA);
+    TLegend& legend = layout.getLegend();
+    legend.Clear();
+    legend.SetX1NDC(legend_position.x1);
+    legend.SetY1NDC(legend_position.y1);
+    legend.SetX2NDC(legend_position.x2);
+    legend.SetY2NDC(legend_position.y2);
+
+    auto fillLegend = [&](int64_t scanPoint) {
+      legend.Clear();
+
+      addToLegend(legend, MC);
+      addToLegend(legend, SIGNAL, scanPoint);
+      addToLegend(legend, DATA);
+
+      if (hasMC && plot.show_errors) {
+        TLegendEntry* entry = legend.AddEntry("errors", "Uncertainties", "f");
+        entry->SetLineWidth(0);
+        entry->SetLineColor(m_config.error_fill_color);
+        entry->SetFillStyle(m_config.error_fill_style);
+        entry->SetFillColor(m_config.error_fill_color);
+      }
 
-    if (hasMC && plot.show_errors) {
-      TLegendEntry* entry = legend.AddEntry("errors", "Uncertainties", "f");
-      entry->SetLineWidth(0);
-      entry->SetLineColor(m_config.error_fill_color);
-      entry->SetFillStyle(m_config.error_fill_style);
-      entry->SetFillColor(m_config.error_fill_color);
-    }
+      // Groups are added once per legend
+      for (auto& group: m_groups) {
+        group.second.added = false;
+      }
+    };
 
+    fillLegend(-1);
     legend.Draw();
 
-    float topMargin = TOP_MARGIN;
-    if (plot.show_ratio)
-      topMargin /= .6666;
-
-    // Luminosity label
-    if (m_config.lumi_label_parsed.length() > 0) {
-      std::shared_ptr<TPaveText> pt = std::make_shared<TPaveText>(LEFT_MARGIN, 1 - 0.5 * topMargin, 1 - RIGHT_MARGIN, 1, "brNDC");
-      m_temporaryObjects.push_back(pt);
-
-      pt->SetFillStyle(0);
-      pt->SetBorderSize(0);
-      pt->SetMargin(0);
-      pt->SetTextFont(42);
-      pt->SetTextSize(0.6 * topMargin);
-      pt->SetTextAlign(33);
-
-      pt->AddText(m_config.lumi_label_parsed.c_str());
-      pt->Draw();
-    }
-
-    // Experiment
-    if (m_config.experiment.length() > 0) {
-      std::shared_ptr<TPaveText> pt = std::make_shared<TPaveText>(LEFT_MARGIN, 1 - 0.5 * topMargin, 1 - RIGHT_MARGIN, 1, "brNDC");
-      m_temporaryObjects.push_back(pt);
-
-      pt->SetFillStyle(0);
-      pt->SetBorderSize(0);
-      pt->SetMargin(0);
-      pt->SetTextFont(62);
-      pt->SetTextSize(0.75 * topMargin);
-      pt->SetTextAlign(13);
-
-      std::string text = m_config.experiment;
-      if (m_config.extra_label.length() || plot.extra_label.length()) {
-        std::string extra_label = plot.extra_label;
-        if (extra_label.length() == 0) {
-          extra_label = m_config.extra_label;
-        }
-
-        boost::format fmt("%s #font[52]{#scale[0.76]{%s}}");
-        fmt % m_config.experiment % extra_label;
-
-        text = fmt.str();
+    // Luminosity and experiment labels
+    std::string experiment = m_config.experiment;
+    if (experiment.length() > 0 && (m_config.extra_label.length() || plot.extra_label.length())) {
+      std::string extra_label = plot.extra_label;
+      if (extra_label.length() == 0) {
+        extra_label = m_config.extra_label;
       }
 
-      pt->AddText(text.c_str());
-      pt->Draw();
+      boost::format fmt("%s #font[52]{#scale[0.76]{%s}}");
+      fmt % m_config.experiment % extra_label;
+
+      experiment = fmt.str();
     }
 
+    layout.drawLabels(experiment);
+
     c.cd();
 
     const auto& labels = mergeLabels(plot.labels);
@@ -606,15 +808,61 @@ namespace plotIt {
       m_temporaryObjects.push_back(t);
     }
 
-    fs::path outputName = m_outputPath / plot.name;
+    auto save = [&](const std::string& name, int64_t scanPoint) {
+      fs::path outputName = m_outputPath / name;
 
-    for (const std::string& extension: plot.save_extensions) {
-      fs::path outputNameWithExtension = outputName.replace_extension(extension);
+      PlotResult result;
+      result.name = name;
+      result.success = true;
 
-      c.SaveAs(outputNameWithExtension.string().c_str());
+      for (const std::string& extension: plot.save_extensions) {
+        fs::path outputNameWithExtension = outputName.replace_extension(extension);
+
+        saveCanvas(c, outputNameWithExtension);
+        result.outputs.push_back(outputNameWithExtension.filename().string());
+      }
+
+      for (size_t i = 0; i < m_files.size(); i++) {
+        const File& file = m_files[i];
+        if (isScanPoint(i) && (int64_t) i != scanPoint)
+          continue;
+
+        result.yields.push_back({fs::path(file.path).stem().string(), file.type, file.summary});
+      }
+      m_results.push_back(result);
+    };
+
+    if (scanPoints.empty()) {
+      save(plot.name, -1);
+    } else {
+      // Everything but the scanned signal is already drawn, and shared by all the points
+      TVirtualPad& pad = layout.getMainPad();
+      for (size_t index: scanPoints) {
+        File& file = m_files[index];
+
+        // The legend stays on top of the signal
+        pad.cd();
+        pad.GetListOfPrimitives()->Remove(&legend);
+
+        std::string options = getPlotStyle(file)->drawing_options + " same";
+        file.object->Draw(options.c_str());
+
+        fillLegend(index);
+        legend.Draw();
+        pad.Modified();
+
+        save(plot.name + "_" + fs::path(file.path).stem().string(), index);
+
+        pad.GetListOfPrimitives()->Remove(file.object);
+      }
     }
 
-    // Close all opened files
+    m_scanPoints.clear();
+
+    writeExportedObjects(plot);
+
+    // Close all opened files, except the objects still drawn in the canvas
+    m_lastPlotObjects.swap(m_temporaryObjects);
     m_temporaryObjects.clear();
 
     // Reset groups
@@ -630,25 +878,182 @@ namespace plotIt {
     return true;
   }
 
-  void plotIt::plotAll() {
+  bool plotIt::plotAll() {
     // First, explode plots to match all glob patterns
 
     //expandFiles();
     std::vector<Plot> plots;
     if (! expandObjects(m_files[0], plots)) {
+      return false;
+    }
+
+    if (m_config.shard_count > 1)
+      selectShard(plots);
+
+    // Fail now rather than in the middle of the run
+    if (! checkInputs(plots)) {
+      Logger::get().flush();
+      return false;
+    }
+
+    // Snapshots are read and written through the input store
+    if (! m_config.snapshot_cache.empty())
+      createInputStore();
+
+    if (! fillTrees(plots)) {
+      Logger::get().flush();
+      return false;
+    }
+
+    uint32_t failed = 0;
+    if (m_config.workers > 1) {
+      // The progress is started once the workers are forked
+      preloadObjects(plots);
+      failed = plotInWorkers(plots);
+    } else if (m_config.threads > 1) {
+      startProgress(plots.size());
+      failed = plotPipelined(plots);
+    } else {
+      startProgress(plots.size());
+      for (Plot& plot: plots) {
+        reportPlotStarted(plot.name);
+
+        bool success = plotIt::plot(plot);
+        if (! success) {
+          failed++;
+
+          PlotResult result;
+          result.name = plot.name;
+          m_results.push_back(result);
+        }
+
+        reportPlotDone(success);
+      }
+    }
+    Logger::get().setContext("");
+
+    if (m_progress.get()) {
+      m_progress->finish();
+      m_progress.reset();
+    }
+
+    closeExportFile();
+
+    LOG(NOTICE) << plots.size() - failed << " plot(s) done, " << failed << " failed";
+    writeOutputsReport();
+
+    if (m_config.shard_count > 1)
+      writeShardSummary();
+
+    Logger::get().flush();
+
+    return failed == 0;
+  }
+
+  /**
+   * Start reporting the progress, if enabled. The progress thread locks the
+   * logger every second: it must not be running when workers are forked, or
+   * a worker could inherit a locked mutex and hang on its first message.
+   **/
+  void plotIt::startProgress(size_t total) {
+    if (m_config.progress || ! m_config.progress_file.empty())
+      m_progress = std::make_shared<Progress>(total, m_config.progress, m_config.progress_file);
+  }
+
+  void plotIt::reportPlotStarted(const std::string& name) {
+    if (m_progress.get())
+      m_progress->setCurrent(name);
+  }
+
+  void plotIt::reportPlotDone(bool success) {
+    if (m_progress.get())
+      m_progress->plotDone(success);
+  }
+
+  /**
+   * Save the canvas into 'path', but only touch the file if its content changed.
+   * The canvas is first saved into a temporary file, which is then atomically
+   * renamed over the existing output if the hashes differ. ROOT writes the file
+   * name into PDF and PS outputs, so the temporary file has the same name, in
+   * a hidden folder next to the output.
+   **/
+  void plotIt::saveCanvas(TCanvas& c, const fs::path& path) {
+    std::string extension = path.extension().string();
+    if (extension.length() > 0)
+      extension = extension.substr(1);
+
+    if (! isDeterministicFormat(extension) || ! fs::exists(path)) {
+      c.SaveAs(path.string().c_str());
+      m_changedOutputs.push_back(path);
       return;
     }
 
-    for (Plot& plot: plots) {
-      plotIt::plot(plot);
+    // Same filesystem as the output, so that the rename is atomic. One folder per
+    // process, workers may save at the same time
+    fs::path temporaryFolder = path.parent_path() / (".plotIt-tmp-" + std::to_string(getpid()));
+    fs::create_directories(temporaryFolder);
+
+    fs::path temporaryPath = temporaryFolder / path.filename();
+    c.SaveAs(temporaryPath.string().c_str());
+
+    if (getOutputHash(temporaryPath) == getOutputHash(path)) {
+      fs::remove(temporaryPath);
+      m_unchangedOutputs++;
+    } else {
+      fs::rename(temporaryPath, path);
+      m_changedOutputs.push_back(path);
     }
+
+    boost::system::error_code error;
+    fs::remove(temporaryFolder, error);
+  }
+
+  /**
+   * Write the list of outputs changed during this run in 'changed_files.txt'
+   **/
+  void plotIt::writeOutputsReport() {
+    fs::path reportPath = m_outputPath / "changed_files.txt";
+    std::ofstream report(reportPath.string().c_str());
+    for (const fs::path& path: m_changedOutputs) {
+      report << path.string() << '\n';
+    }
+
+    LOG(NOTICE) << m_changedOutputs.size() << " output(s) changed, " << m_unchangedOutputs << " unchanged. List of changed files written in " << reportPath;
   }
 
   bool plotIt::loadObject(File& file, const Plot& plot) {
 
     file.object = nullptr;
 
-    std::shared_ptr<TFile> input(TFile::Open(file.path.c_str()));
+    if (m_inputs.get()) {
+      // Objects of a shared store may be needed by other configurations, keep them there
+      bool keepInStore = m_inputs.use_count() > 1;
+
+      auto load = [&](const std::string& path, const std::string& name) -> TObject* {
+        if (keepInStore)
+          return getStoredObject(path, name, m_temporaryObjects);
+
+        std::shared_ptr<TObject> object = m_inputs->takeObject(getInputPath(path), name);
+        if (object.get())
+          m_temporaryObjects.push_back(object);
+
+        return object.get();
+      };
+
+      file.object = load(file.path, plot.name);
+      if (! file.object) {
+        LOG(ERROR) << "object '" << plot.name << "' inheriting from '" << plot.inherits_from << "' not found in file '" << file.path << "'";
+        return false;
+      }
+
+      for (Systematic& syst: file.systematics) {
+        syst.object = load(syst.path, syst.getObjectName(plot.name));
+      }
+
+      return true;
+    }
+
+    std::shared_ptr<TFile> input(TFile::Open(getInputPath(file.path).c_str()));
     if (! input.get())
       return false;
 
@@ -658,16 +1063,24 @@ namespace plotIt {
       m_temporaryObjects.push_back(input);
       file.object = obj;
 
-      // Load systematics histograms
+      // Load systematics histograms. Variations stored in the nominal file, or
+      // several variations in the same file, are read through a single handle
+      std::map<std::string, std::shared_ptr<TFile>> inputs_syst;
+      inputs_syst[file.path] = input;
+
       for (Systematic& syst: file.systematics) {
 
         syst.object = nullptr;
 
-        std::shared_ptr<TFile> input_syst(TFile::Open(syst.path.c_str()));
+        auto it = inputs_syst.find(syst.path);
+        if (it == inputs_syst.end())
+          it = inputs_syst.insert(std::make_pair(syst.path, std::shared_ptr<TFile>(TFile::Open(getInputPath(syst.path).c_str())))).first;
+
+        std::shared_ptr<TFile> input_syst = it->second;
         if (! input_syst.get())
           continue;
 
-        obj = input_syst->Get(plot.name.c_str());
+        obj = input_syst->Get(syst.getObjectName(plot.name).c_str());
         if (obj) {
           m_temporaryObjects.push_back(input_syst);
           syst.object = obj;
@@ -678,10 +1091,96 @@ namespace plotIt {
     }
 
     // Should not be possible!
-    std::cout << "Error: object '" << plot.name << "' inheriting from '" << plot.inherits_from << "' not found in file '" << file.path << "'" << std::endl;
+    LOG(ERROR) << "object '" << plot.name << "' inheriting from '" << plot.inherits_from << "' not found in file '" << file.path << "'";
     return false;
   }
 
+  /**
+   * Create the store of the inputs if needed, reading from the snapshot cache if enabled
+   **/
+  void plotIt::createInputStore() {
+    if (! m_inputs.get())
+      m_inputs = std::make_shared<InputStore>();
+
+    if (! m_config.snapshot_cache.empty())
+      m_inputs->enableSnapshots(m_config.snapshot_cache);
+  }
+
+  /**
+   * Return a copy of an object of the input store, owned by 'owner'.
+   * Plotters modify the objects in place (scaling, rebinning, ...), so the
+   * stored one must never be handed out directly.
+   **/
+  TObject* plotIt::getStoredObject(const std::string& path, const std::string& name, std::vector<std::shared_ptr<TObject>>& owner) {
+    const TObject* stored = m_inputs->getObject(getInputPath(path), name);
+    if (! stored)
+      return nullptr;
+
+    std::shared_ptr<TObject> copy(stored->Clone());
+    if (TH1* h = dynamic_cast<TH1*>(copy.get()))
+      h->SetDirectory(nullptr);
+
+    owner.push_back(copy);
+
+    return copy.get();
+  }
+
+  /**
+   * Return the path to open for the input 'path', which is a local copy
+   * if the input cache is enabled
+   **/
+  std::string plotIt::getInputPath(const std::string& path) {
+    if (m_config.input_cache.empty())
+      return path;
+
+    if (! m_inputCache.get())
+      m_inputCache = std::make_shared<InputCache>(m_config.input_cache, m_config.input_cache_size);
+
+    return m_inputCache->get(path);
+  }
+
+  std::set<std::string> plotIt::getInputFiles() const {
+    std::set<std::string> paths;
+    for (const File& file: m_files) {
+      paths.insert(file.path);
+
+      for (const Systematic& syst: file.systematics)
+        paths.insert(syst.path);
+    }
+
+    return paths;
+  }
+
+  void plotIt::releaseInputs(const std::set<std::string>& needed) {
+    if (! m_inputs.get())
+      return;
+
+    for (const std::string& path: getInputFiles()) {
+      if (needed.count(path))
+        continue;
+
+      // Inputs never resolved were never read, and must not be copied into the input cache now
+      std::string resolved = path;
+      if (! m_config.input_cache.empty() && (! m_inputCache.get() || ! m_inputCache->getResolved(path, resolved)))
+        continue;
+
+      m_inputs->release(resolved);
+    }
+  }
+
+  std::string plotIt::getSampleName(const File& file) const {
+    fs::path path = file.path;
+
+    std::string root = fs::path(m_config.root).string();
+    if (! root.empty() && file.path.compare(0, root.length(), root) == 0) {
+      path = file.path.substr(root.length());
+      if (path.has_root_directory())
+        path = path.relative_path();
+    }
+
+    return path.replace_extension().string();
+  }
+
   bool plotIt::expandFiles() {
     std::vector<File> files;
 
@@ -733,80 +1232,80 @@ namespace plotIt {
     file.object = nullptr;
     plots.clear();
 
-    std::shared_ptr<TFile> input(TFile::Open(file.path.c_str()));
-    if (! input.get())
-      return false;
+    // Only the keys metadata are needed, objects are not read
+    std::vector<InputStore::Key> localKeys;
+    const std::vector<InputStore::Key>* keys = &localKeys;
+    if (m_inputs.get()) {
+      keys = m_inputs->getKeys(getInputPath(file.path));
+      if (! keys)
+        return false;
+    } else {
+      std::shared_ptr<TFile> input(TFile::Open(getInputPath(file.path).c_str()));
+      if (! input.get())
+        return false;
 
-    TIter keys(input->GetListOfKeys());
+      TIter next(input->GetListOfKeys());
+      TKey* key;
+      while ((key = static_cast<TKey*>(next()))) {
+        localKeys.push_back({key->GetName(), key->GetClassName()});
+      }
+    }
 
     for (Plot& plot: m_plots) {
-      TKey* key;
-      TObject* obj;
+      // Filled from the trees, there's nothing to match
+      if (! plot.variable.empty()) {
+        plots.push_back(plot);
+        continue;
+      }
+
       bool match = false;
 
-      keys.Reset();
-      while ((key = static_cast<TKey*>(keys()))) {
-        obj = key->ReadObj();
-        if (! obj->InheritsFrom(plot.inherits_from.c_str()))
+      for (const InputStore::Key& key: *keys) {
+        TClass* cls = TClass::GetClass(key.class_name.c_str());
+        if (! cls || ! cls->InheritsFrom(plot.inherits_from.c_str()))
           continue;
 
         // Check name
-        if (fnmatch(plot.name.c_str(), obj->GetName(), FNM_CASEFOLD) == 0) {
+        if (fnmatch(plot.name.c_str(), key.name.c_str(), FNM_CASEFOLD) == 0) {
 
           // Check if this name is excluded
-          if ((plot.exclude.length() > 0) && (fnmatch(plot.exclude.c_str(), obj->GetName(), FNM_CASEFOLD) == 0)) {
+          if ((plot.exclude.length() > 0) && (fnmatch(plot.exclude.c_str(), key.name.c_str(), FNM_CASEFOLD) == 0)) {
             continue;
           }
 
           // Got it!
           match = true;
-          plots.push_back(plot.Clone(obj->GetName()));
+          plots.push_back(plot.Clone(key.name));
         }
       }
 
       if (! match) {
-        std::cout << "Warning: object '" << plot.name << "' inheriting from '" << plot.inherits_from << "' does not match something in file '" << file.path << "'" << std::endl;
+        LOG(WARNING) << "object '" << plot.name << "' inheriting from '" << plot.inherits_from << "' does not match something in file '" << file.path << "'";
       }
     }
 
     if (!plots.size()) {
-      std::cout << "Error: no plots found in file '" << file.path << "'" << std::endl;
+      LOG(ERROR) << "no plots found in file '" << file.path << "'";
       return false;
     }
 
     return true;
   }
 
-  std::shared_ptr<PlotStyle> plotIt::getPlotStyle(const File& file) {
-    if (file.group.length() && m_groups.count(file.group)) {
-      return m_groups[file.group].plot_style;
-    } else {
-      return file.plot_style;
-    }
-  }
-
-  void PlotStyle::loadFromYAML(YAML::Node& node, const File& file, plotIt& pIt) {
-    if (node["legend"])
-      legend = node["legend"].as<std::string>();
+  void PlotStyle::loadDefaults(Type type) {
+    legend.clear();
 
-    if (file.type == MC)
+    if (type == MC)
       legend_style = "lf";
-    else if (file.type == SIGNAL)
+    else if (type == SIGNAL)
       legend_style = "l";
-    else if (file.type == DATA)
+    else if (type == DATA)
       legend_style = "p";
 
-    if (node["legend-style"])
-      legend_style = node["legend-style"].as<std::string>();
-
-    if (node["drawing-options"])
-      drawing_options = node["drawing-options"].as<std::string>();
-    else {
-      if (file.type == MC || file.type == SIGNAL)
-        drawing_options = "hist";
-      else if (file.type == DATA)
-        drawing_options = "P";
-    }
+    if (type == MC || type == SIGNAL)
+      drawing_options = "hist";
+    else if (type == DATA)
+      drawing_options = "P";
 
     marker_size = -1;
     marker_color = -1;
@@ -818,11 +1317,11 @@ namespace plotIt {
     line_color = -1;
     line_type = -1;
 
-    if (file.type == MC) {
+    if (type == MC) {
       fill_color = 1;
       fill_type = 1001;
       line_width = 0;
-    } else if (file.type == SIGNAL) {
+    } else if (type == SIGNAL) {
       fill_type = 0;
       line_color = 1;
       line_width = 1;
@@ -834,6 +1333,19 @@ namespace plotIt {
       line_color = 1;
       line_width = 1; // For uncertainties
     }
+  }
+
+  void PlotStyle::loadFromYAML(YAML::Node& node, const File& file, plotIt& pIt) {
+    loadDefaults(file.type);
+
+    if (node["legend"])
+      legend = node["legend"].as<std::string>();
+
+    if (node["legend-style"])
+      legend_style = node["legend-style"].as<std::string>();
+
+    if (node["drawing-options"])
+      drawing_options = node["drawing-options"].as<std::string>();
 
     if (node["fill-color"])
       fill_color = pIt.loadColor(node["fill-color"]);
@@ -860,39 +1372,3 @@ namespace plotIt {
       marker_size = node["marker-size"].as<float>();
   }
 }
-
-int main(int argc, char** argv) {
-
-  try {
-
-    TCLAP::CmdLine cmd("Plot histograms", ' ', "0.1");
-
-    TCLAP::ValueArg<std::string> outputFolderArg("o", "output-folder", "output folder", true, "", "string", cmd);
-
-    TCLAP::SwitchArg ignoreScaleArg("", "ignore-scales", "Ignore any scales present in the configuration file", cmd, false);
-
-    TCLAP::UnlabeledValueArg<std::string> configFileArg("configFile", "configuration file", true, "", "string", cmd);
-
-    cmd.parse(argc, argv);
-
-    //bool isData = dataArg.isSet();
-
-    fs::path outputPath(outputFolderArg.getValue());
-
-    if (! fs::exists(outputPath)) {
-      std::cout << "Error: output path " << outputPath << " does not exist" << std::endl;
-      return 1;
-    }
-
-    plotIt::plotIt p(outputPath, configFileArg.getValue());
-    p.getConfigurationForEditing().ignore_scales = ignoreScaleArg.getValue();
-
-    p.plotAll();
-
-  } catch (TCLAP::ArgException &e) {
-    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
-    return 1;
-  }
-
-  return 0;
-}
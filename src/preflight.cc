@@ -0,0 +1,184 @@
+#include "plotIt.h"
+
+#include <TClass.h>
+#include <TDirectory.h>
+#include <TCollection.h>
+#include <TFile.h>
+#include <TKey.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include <logging.h>
+#include <utilities.h>
+
+/**
+ * Pre-flight validation: before drawing anything, check that every input
+ * and systematics file can be opened, is healthy, and contains every
+ * expanded plot with a compatible class. Files are checked in parallel,
+ * and all the problems are reported at once.
+ **/
+
+namespace plotIt {
+
+  struct Binning {
+    int32_t n_bins;
+    double x_min;
+    double x_max;
+  };
+
+  struct InputToCheck {
+    std::string path;
+    std::string resolved;
+
+    // Directories containing the objects, with a trailing '/'. Empty for the top-level directory
+    std::vector<std::string> directories;
+
+    // Tree the histograms are filled from, if any
+    std::string tree;
+  };
+
+  /**
+   * Check all the files against 'plots'. Return false, after logging every
+   * problem found, if plotting would fail.
+   **/
+  bool plotIt::checkInputs(const std::vector<Plot>& plots) {
+    // Resolve paths first, the input cache is not thread safe. Each file is opened
+    // once, and checked for all the directories holding objects: the top-level one, and
+    // 'syst/<name>/' for variations stored inside a file
+    std::vector<InputToCheck> paths;
+    std::map<std::string, size_t> indices;
+    auto addInput = [&](const std::string& path, const std::string& directory, const std::string& tree) {
+      auto it = indices.find(path);
+      if (it == indices.end()) {
+        it = indices.insert(std::make_pair(path, paths.size())).first;
+        paths.push_back({path, getInputPath(path), {}, tree});
+      }
+
+      std::vector<std::string>& directories = paths[it->second].directories;
+      if (std::find(directories.begin(), directories.end(), directory) == directories.end())
+        directories.push_back(directory);
+    };
+
+    for (File& file: m_files) {
+      addInput(file.path, "", file.tree);
+      for (Systematic& syst: file.systematics)
+        addInput(syst.path, syst.getObjectName(""), file.tree);
+    }
+
+    // Reference binning, taken from the file the plots were expanded from
+    std::map<std::string, Binning> binnings;
+    if (m_config.check_binning) {
+      std::shared_ptr<TFile> reference(TFile::Open(paths[0].resolved.c_str()));
+      for (const Plot& plot: plots) {
+        std::unique_ptr<TH1> h(reference.get() ? dynamic_cast<TH1*>(reference->Get(plot.name.c_str())) : nullptr);
+        if (h.get()) {
+          h->SetDirectory(nullptr);
+          binnings[plot.name] = {h->GetNbinsX(), h->GetXaxis()->GetXmin(), h->GetXaxis()->GetXmax()};
+        }
+      }
+    }
+
+    uint16_t threads = enableThreadSafety(m_config.threads);
+
+    std::vector<std::vector<std::string>> errors(paths.size());
+
+    parallelFor(paths.size(), threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          std::vector<std::string>& fileErrors = errors[i];
+
+          std::shared_ptr<TFile> input(TFile::Open(paths[i].resolved.c_str()));
+          if (! input.get()) {
+            fileErrors.push_back("cannot be opened");
+            continue;
+          }
+
+          if (input->IsZombie()) {
+            fileErrors.push_back("is a zombie");
+            continue;
+          }
+
+          if (input->TestBit(TFile::kRecovered))
+            fileErrors.push_back("was not closed properly and has been recovered");
+
+          for (const std::string& directory: paths[i].directories) {
+            TDirectory* dir = input.get();
+            if (! directory.empty()) {
+              dir = input->GetDirectory(directory.substr(0, directory.length() - 1).c_str());
+              if (! dir) {
+                fileErrors.push_back("directory '" + directory + "' not found");
+                continue;
+              }
+            }
+
+            std::map<std::string, std::string> classes;
+            TIter next(dir->GetListOfKeys());
+            TKey* key;
+            while ((key = static_cast<TKey*>(next()))) {
+              classes[key->GetName()] = key->GetClassName();
+            }
+
+            if (! paths[i].tree.empty() && directory.empty()) {
+              auto it = classes.find(paths[i].tree);
+              TClass* cls = (it == classes.end()) ? nullptr : TClass::GetClass(it->second.c_str());
+              if (! cls || ! cls->InheritsFrom("TTree"))
+                fileErrors.push_back("tree '" + paths[i].tree + "' not found");
+            }
+
+            for (const Plot& plot: plots) {
+              std::string name = directory + plot.name;
+
+              // Filled from the tree
+              if (! plot.variable.empty()) {
+                if (paths[i].tree.empty())
+                  fileErrors.push_back("has no tree to fill '" + plot.name + "' from");
+                continue;
+              }
+
+              auto it = classes.find(plot.name);
+              if (it == classes.end()) {
+                fileErrors.push_back("object '" + name + "' not found");
+                continue;
+              }
+
+              TClass* cls = TClass::GetClass(it->second.c_str());
+              if (! cls || ! cls->InheritsFrom(plot.inherits_from.c_str())) {
+                fileErrors.push_back("object '" + name + "' is a '" + it->second + "', which does not inherit from '" + plot.inherits_from + "'");
+                continue;
+              }
+
+              auto binning = binnings.find(plot.name);
+              if (binning != binnings.end()) {
+                std::unique_ptr<TH1> h(dynamic_cast<TH1*>(dir->Get(plot.name.c_str())));
+                if (h.get()) {
+                  h->SetDirectory(nullptr);
+                  if (h->GetNbinsX() != binning->second.n_bins ||
+                      h->GetXaxis()->GetXmin() != binning->second.x_min ||
+                      h->GetXaxis()->GetXmax() != binning->second.x_max) {
+                    fileErrors.push_back("object '" + name + "' has a different binning than in '" + paths[0].path + "'");
+                  }
+                }
+              }
+            }
+          }
+        }
+      });
+
+    uint32_t n_errors = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+      for (const std::string& error: errors[i]) {
+        LOG(ERROR) << "'" << paths[i].path << "' " << error;
+        n_errors++;
+      }
+    }
+
+    if (n_errors) {
+      LOG(ERROR) << n_errors << " problem(s) found in the inputs, nothing has been drawn";
+      return false;
+    }
+
+    LOG(INFO) << paths.size() << " input file(s) checked for " << plots.size() << " plot(s)";
+
+    return true;
+  }
+}
@@ -0,0 +1,191 @@
+#include "plotIt.h"
+
+#include <ctime>
+#include <fstream>
+#include <iterator>
+
+#include <TSystem.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/format.hpp>
+
+#include <logging.h>
+#include <utilities.h>
+
+/**
+ * Sharding: '--shard i/N' draws only the plots whose name hashes to i
+ * modulo N, and writes a partial summary in the output folder. Once all
+ * the shards are done, '--merge' combines these partial summaries into
+ * the final yields table and index. The only thing shared between shards
+ * is the output folder. Each summary records the run which wrote it, so
+ * that leftovers of an older run are never merged.
+ **/
+
+namespace plotIt {
+
+  static fs::path getShardSummaryPath(const fs::path& outputPath, uint32_t index, uint32_t count) {
+    return outputPath / (boost::format("plotIt-shard-%d-of-%d.yml") % index % count).str();
+  }
+
+  /**
+   * Identifier of a sharded run: a hash of the configuration files, and of
+   * the size and modification date of the inputs. All the shards of a run
+   * get the same one, and a merge only combines the summaries matching its own.
+   **/
+  std::string plotIt::getShardRunId() {
+    std::string content;
+    for (const std::string& source: m_configurationSources) {
+      std::ifstream f(source.c_str(), std::ios::in | std::ios::binary);
+      content.append(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+
+    for (const std::string& path: getInputFiles()) {
+      FileStat_t stat;
+      if (gSystem->GetPathInfo(path.c_str(), stat) == 0)
+        content += (boost::format("%s %d %d\n") % path % stat.fSize % stat.fMtime).str();
+      else
+        content += path + " missing\n";
+    }
+
+    return (boost::format("%016x") % stableHash(content)).str();
+  }
+
+  void plotIt::selectShard(std::vector<Plot>& plots) {
+    size_t total = plots.size();
+
+    plots.erase(
+        std::remove_if(plots.begin(), plots.end(), [this](const Plot& plot) {
+          return stableHash(plot.name) % m_config.shard_count != m_config.shard_index;
+          }), plots.end()
+        );
+
+    LOG(INFO) << "Shard " << m_config.shard_index << "/" << m_config.shard_count << ": " << plots.size() << " plot(s) out of " << total;
+
+    // Summaries of an earlier run with another number of shards would be merged with the ones of this run
+    for (const std::string& file: glob((m_outputPath / "plotIt-shard-*-of-*.yml").string())) {
+      if (! boost::algorithm::ends_with(file, (boost::format("-of-%d.yml") % m_config.shard_count).str())) {
+        boost::system::error_code error;
+        fs::remove(file, error);
+      }
+    }
+  }
+
+  void plotIt::writeShardSummary() {
+    YAML::Node summary;
+    summary["shard"] = m_config.shard_index;
+    summary["shards"] = m_config.shard_count;
+    summary["run"] = getShardRunId();
+
+    for (const fs::path& path: m_changedOutputs)
+      summary["changed-outputs"].push_back(path.filename().string());
+
+    for (const PlotResult& result: m_results)
+      summary["plots"].push_back(result);
+
+    fs::path path = getShardSummaryPath(m_outputPath, m_config.shard_index, m_config.shard_count);
+    std::ofstream out(path.string().c_str());
+    out << summary << std::endl;
+
+    LOG(NOTICE) << "Shard summary written in " << path;
+  }
+
+  bool plotIt::mergeShards() {
+    std::vector<std::string> summaries = glob((m_outputPath / "plotIt-shard-*-of-*.yml").string());
+    if (! summaries.size()) {
+      LOG(ERROR) << "no shard summary found in " << m_outputPath;
+      return false;
+    }
+
+    // Only the summaries of the run matching this configuration and its
+    // inputs are merged, with the number of shards of the most recent one
+    std::string run = getShardRunId();
+    std::vector<YAML::Node> matching;
+    std::time_t latest = 0;
+    uint32_t count = 0;
+    for (const std::string& file: summaries) {
+      YAML::Node summary = YAML::LoadFile(file);
+      if (! summary["run"] || summary["run"].as<std::string>() != run) {
+        LOG(WARNING) << "ignoring shard summary '" << file << "', produced by another run (different configuration or inputs)";
+        continue;
+      }
+
+      std::time_t time = fs::last_write_time(file);
+      if (count == 0 || time > latest) {
+        latest = time;
+        count = summary["shards"].as<uint32_t>();
+      }
+
+      summary["file"] = file;
+      matching.push_back(summary);
+    }
+
+    if (! matching.size()) {
+      LOG(ERROR) << "no shard summary of this run found in " << m_outputPath;
+      return false;
+    }
+
+    std::vector<PlotResult> results;
+    std::vector<std::string> changedOutputs;
+    std::vector<bool> found(count, false);
+    size_t merged = 0;
+
+    for (const YAML::Node& summary: matching) {
+      uint32_t shard = summary["shard"].as<uint32_t>();
+      uint32_t shards = summary["shards"].as<uint32_t>();
+      if (shards != count) {
+        LOG(WARNING) << "ignoring shard summary '" << summary["file"].as<std::string>() << "', produced with " << shards << " shards instead of " << count;
+        continue;
+      }
+
+      if (shard >= count)
+        continue;
+      found[shard] = true;
+      merged++;
+
+      for (const YAML::Node& node: summary["plots"])
+        results.push_back(node.as<PlotResult>());
+
+      for (const YAML::Node& node: summary["changed-outputs"])
+        changedOutputs.push_back(node.as<std::string>());
+    }
+
+    bool complete = true;
+    for (uint32_t i = 0; i < count; i++) {
+      if (! found[i]) {
+        LOG(WARNING) << "summary of shard " << i << "/" << count << " is missing";
+        complete = false;
+      }
+    }
+
+    // Shards are processed in any order, sort by name to get a deterministic output
+    std::sort(results.begin(), results.end(), [](const PlotResult& a, const PlotResult& b) {
+        return a.name < b.name;
+      });
+    std::sort(changedOutputs.begin(), changedOutputs.end());
+
+    YAML::Node yields;
+    std::ofstream index((m_outputPath / "index.txt").string().c_str());
+    uint32_t failed = 0;
+    for (const PlotResult& result: results) {
+      yields.push_back(result);
+
+      if (! result.success) {
+        failed++;
+        index << result.name << ": FAILED" << '\n';
+      } else {
+        index << result.name << ": " << boost::algorithm::join(result.outputs, " ") << '\n';
+      }
+    }
+
+    std::ofstream yieldsFile((m_outputPath / "yields.yml").string().c_str());
+    yieldsFile << yields << std::endl;
+
+    std::ofstream changed((m_outputPath / "changed_files.txt").string().c_str());
+    for (const std::string& output: changedOutputs)
+      changed << (m_outputPath / output).string() << '\n';
+
+    LOG(NOTICE) << "Merged " << merged << " shard summaries: " << results.size() - failed << " plot(s) done, " << failed << " failed, " << changedOutputs.size() << " output(s) changed";
+
+    return complete && failed == 0;
+  }
+}
@@ -0,0 +1,72 @@
+#include "plotIt.h"
+
+#include <TH1.h>
+
+#include <InputStore.h>
+#include <TreeFiller.h>
+#include <logging.h>
+
+namespace plotIt {
+
+  /**
+   * Fill the plots having a variable from the files with a tree, and make the
+   * histograms available through the input store, as if they were read from
+   * the files. Systematics files are filled from the tree with the same name.
+   **/
+  bool plotIt::fillTrees(const std::vector<Plot>& plots) {
+    std::vector<TreeFiller::Histogram> histograms;
+    for (const Plot& plot: plots) {
+      if (! plot.variable.empty())
+        histograms.push_back({plot.name, plot.variable, plot.cut, plot.binning});
+    }
+
+    bool hasTrees = false;
+    for (File& file: m_files)
+      hasTrees |= ! file.tree.empty();
+
+    if (! hasTrees)
+      return true;
+
+    if (histograms.empty()) {
+      LOG(WARNING) << "some files have a tree, but no plot has a variable";
+      return true;
+    }
+
+    createInputStore();
+
+    TreeFiller filler(m_config.tree_cache, m_config.threads);
+
+    auto fill = [&](const std::string& path, const std::string& tree) {
+      std::string inputPath = getInputPath(path);
+
+      std::map<std::string, std::shared_ptr<TH1>> result;
+      if (! filler.fill(inputPath, tree, histograms, result))
+        return false;
+
+      for (auto& h: result)
+        m_inputs->setObject(inputPath, h.first, h.second);
+
+      return true;
+    };
+
+    for (File& file: m_files) {
+      if (file.tree.empty())
+        continue;
+
+      if (! fill(file.path, file.tree))
+        return false;
+
+      for (Systematic& syst: file.systematics) {
+        if (! syst.name.empty()) {
+          LOG(WARNING) << "systematic '" << syst.name << "' of '" << file.path << "' ignored: variations stored in directories are not supported for trees";
+          continue;
+        }
+
+        if (! fill(syst.path, file.tree))
+          return false;
+      }
+    }
+
+    return true;
+  }
+}
@@ -1,8 +1,18 @@
 #include <utilities.h>
 
+#include <RVersion.h>
 #include <TH1.h>
-#include <THStack.h>
+#include <TROOT.h>
 #include <TStyle.h>
+#include <TMD5.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include <logging.h>
 
 namespace plotIt {
 
@@ -115,63 +125,248 @@ namespace plotIt {
     return style;
   }
 
-  void setAxisTitles(TObject* object, Plot& plot) {
-    if (dynamic_cast<TH1*>(object))
-      setAxisTitles(dynamic_cast<TH1*>(object), plot);
-    else if (dynamic_cast<THStack*>(object))
-      setAxisTitles(dynamic_cast<THStack*>(object), plot);
-  }
+  bool isDeterministicFormat(const std::string& extension) {
+    static const std::vector<std::string> formats = {"pdf", "ps", "eps", "svg", "png", "gif", "jpg"};
 
-  void setDefaultStyle(TObject* object, float topBottomScaleFactor) {
-    if (dynamic_cast<TH1*>(object))
-      setDefaultStyle(dynamic_cast<TH1*>(object), topBottomScaleFactor);
-    else if (dynamic_cast<THStack*>(object))
-      setDefaultStyle(dynamic_cast<THStack*>(object)->GetHistogram(), topBottomScaleFactor);
+    return std::find(formats.begin(), formats.end(), extension) != formats.end();
   }
 
-  void hideXTitle(TObject* object) {
-    if (dynamic_cast<TH1*>(object))
-      hideXTitle(dynamic_cast<TH1*>(object));
-    else if (dynamic_cast<THStack*>(object))
-      hideXTitle(dynamic_cast<THStack*>(object));
+  std::string getOutputHash(const fs::path& path) {
+    std::ifstream f(path.string().c_str(), std::ios::in | std::ios::binary);
+    if (! f.good())
+      return "";
+
+    TMD5 md5;
+    std::string line;
+    while (std::getline(f, line)) {
+      // ROOT stamps PDF, PS and SVG files with the date of creation
+      if (line.find("CreationDate") != std::string::npos || line.find("ModDate") != std::string::npos)
+        continue;
+
+      line.push_back('\n');
+      md5.Update(reinterpret_cast<const unsigned char*>(line.data()), line.length());
+    }
+
+    md5.Final();
+
+    return md5.AsString();
   }
 
-  float getMaximum(TObject* object) {
-    if (dynamic_cast<TH1*>(object))
-      return getMaximum(dynamic_cast<TH1*>(object));
-    else if (dynamic_cast<THStack*>(object))
-      return getMaximum(dynamic_cast<THStack*>(object));
+  uint64_t stableHash(const std::string& str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c: str) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ULL;
+    }
 
-    return std::numeric_limits<float>::lowest();
+    return hash;
   }
 
-  float getMinimum(TObject* object) {
-    if (dynamic_cast<TH1*>(object))
-      return getMinimum(dynamic_cast<TH1*>(object));
-    else if (dynamic_cast<THStack*>(object))
-      return getMinimum(dynamic_cast<THStack*>(object));
+  std::string escapeJSON(const std::string& str) {
+    std::string escaped;
+    escaped.reserve(str.length());
+
+    for (char c: str) {
+      switch (c) {
+        case '"':
+          escaped += "\\\"";
+          break;
+        case '\\':
+          escaped += "\\\\";
+          break;
+        case '\n':
+          escaped += "\\n";
+          break;
+        case '\t':
+          escaped += "\\t";
+          break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            char code[7];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+          } else {
+            escaped += c;
+          }
+      }
+    }
+
+    return escaped;
+  }
 
-    return std::numeric_limits<float>::infinity();
+  uint16_t enableThreadSafety(uint16_t threads) {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 0, 0)
+    ROOT::EnableThreadSafety();
+    return threads;
+#else
+    static bool warned = false;
+    if (threads > 1 && ! warned) {
+      LOG(WARNING) << "ROOT 5 is not thread-safe, using only one thread";
+      warned = true;
+    }
+
+    return 1;
+#endif
   }
 
-  void setMaximum(TObject* object, float minimum) {
-    if (dynamic_cast<TH1*>(object))
-      setMaximum(dynamic_cast<TH1*>(object), minimum);
-    else if (dynamic_cast<THStack*>(object))
-      setMaximum(dynamic_cast<THStack*>(object), minimum);
+  void parallelFor(size_t n, uint16_t threads, const std::function<void(size_t, size_t)>& f) {
+    size_t n_threads = std::min<size_t>(std::max<uint16_t>(threads, 1), n);
+    if (n_threads <= 1) {
+      f(0, n);
+      return;
+    }
+
+    size_t chunk = (n + n_threads - 1) / n_threads;
+
+    std::vector<std::thread> pool;
+    for (size_t begin = chunk; begin < n; begin += chunk) {
+      pool.push_back(std::thread(f, begin, std::min(begin + chunk, n)));
+    }
+
+    // The first chunk is processed by the calling thread
+    f(0, std::min(chunk, n));
+
+    for (std::thread& thread: pool)
+      thread.join();
   }
 
-  void setMinimum(TObject* object, float minimum) {
-    if (dynamic_cast<TH1*>(object))
-      setMinimum(dynamic_cast<TH1*>(object), minimum);
-    else if (dynamic_cast<THStack*>(object))
-      setMinimum(dynamic_cast<THStack*>(object), minimum);
+  TH1* sumHistograms(const std::vector<TH1*>& histograms, uint16_t threads) {
+    if (histograms.empty())
+      return nullptr;
+
+    size_t n = histograms.size();
+    size_t n_cells = histograms[0]->GetNcells();
+
+    // Below this number of additions, threads cost more than they save
+    const size_t min_parallel_work = 1 << 16;
+    if (n * n_cells < min_parallel_work)
+      threads = 1;
+
+    // Contents and squared errors of every input, including under- and overflows
+    std::vector<std::vector<double>> contents(n, std::vector<double>(n_cells));
+    std::vector<std::vector<double>> sumw2(n, std::vector<double>(n_cells));
+
+    parallelFor(n, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          for (size_t bin = 0; bin < n_cells; bin++) {
+            double error = histograms[i]->GetBinError(bin);
+            contents[i][bin] = histograms[i]->GetBinContent(bin);
+            sumw2[i][bin] = error * error;
+          }
+        }
+      });
+
+    // Pairwise reduction: at each level, input i + stride is added into input i
+    for (size_t stride = 1; stride < n; stride *= 2) {
+      size_t n_pairs = (n + 2 * stride - 1) / (2 * stride);
+
+      parallelFor(n_pairs, threads, [&](size_t begin, size_t end) {
+          for (size_t pair = begin; pair < end; pair++) {
+            size_t i = pair * 2 * stride;
+            size_t j = i + stride;
+            if (j >= n)
+              continue;
+
+            double* c = contents[i].data();
+            double* w = sumw2[i].data();
+            const double* other_c = contents[j].data();
+            const double* other_w = sumw2[j].data();
+            for (size_t bin = 0; bin < n_cells; bin++) {
+              c[bin] += other_c[bin];
+              w[bin] += other_w[bin];
+            }
+          }
+        });
+    }
+
+    double entries = 0;
+    for (TH1* h: histograms)
+      entries += h->GetEntries();
+
+    TH1* sum = static_cast<TH1*>(histograms[0]->Clone());
+    sum->SetDirectory(nullptr);
+    for (size_t bin = 0; bin < n_cells; bin++) {
+      sum->SetBinContent(bin, contents[0][bin]);
+      sum->SetBinError(bin, std::sqrt(sumw2[0][bin]));
+    }
+
+    sum->ResetStats();
+    sum->SetEntries(entries);
+
+    return sum;
   }
 
-  void setRange(TObject* object, Plot& plot) {
-    if (dynamic_cast<TH1*>(object))
-      setRange(dynamic_cast<TH1*>(object), plot);
-    else if (dynamic_cast<THStack*>(object))
-      setRange(dynamic_cast<THStack*>(object)->GetHistogram(), plot);
+  void computeRatio(RatioType type, const TH1* data, const TH1* mc, const TH1* mc_syst_only, TH1* ratio, TH1* systematics, RatioBuffers& buffers) {
+    size_t n_cells = data->GetNcells();
+
+    std::vector<double>& d = buffers.d;
+    std::vector<double>& d_err2 = buffers.d_err2;
+    std::vector<double>& m = buffers.m;
+    std::vector<double>& m_err2 = buffers.m_err2;
+    std::vector<double>& m_syst = buffers.m_syst;
+    std::vector<double>& r = buffers.r;
+    std::vector<double>& r_err = buffers.r_err;
+    std::vector<double>& band = buffers.band;
+    std::vector<double>& band_err = buffers.band_err;
+    for (std::vector<double>* buffer: {&d, &d_err2, &m, &m_err2, &m_syst, &r, &r_err, &band, &band_err})
+      buffer->resize(n_cells);
+
+    for (size_t bin = 0; bin < n_cells; bin++) {
+      double error = data->GetBinError(bin);
+      d[bin] = data->GetBinContent(bin);
+      d_err2[bin] = error * error;
+
+      error = mc->GetBinError(bin);
+      m[bin] = mc->GetBinContent(bin);
+      m_err2[bin] = error * error;
+
+      m_syst[bin] = mc_syst_only->GetBinError(bin);
+    }
+
+    for (size_t bin = 0; bin < n_cells; bin++) {
+      r[bin] = r_err[bin] = band[bin] = band_err[bin] = 0;
+      if (m[bin] == 0)
+        continue;
+
+      switch (type) {
+        case RATIO: {
+          // Same errors as TH1::Divide, for uncorrelated histograms
+          double m2 = m[bin] * m[bin];
+          r[bin] = d[bin] / m[bin];
+          r_err[bin] = std::sqrt((d_err2[bin] * m2 + m_err2[bin] * d[bin] * d[bin]) / (m2 * m2));
+
+          band[bin] = 1;
+          band_err[bin] = 1 - m[bin] / (m_syst[bin] + m[bin]);
+          break;
+        }
+
+        case PULL: {
+          double sigma = std::sqrt(d_err2[bin] + m_err2[bin] + m_syst[bin] * m_syst[bin]);
+          if (sigma == 0)
+            break;
+
+          r[bin] = (d[bin] - m[bin]) / sigma;
+          r_err[bin] = std::sqrt(d_err2[bin]) / sigma;
+          band_err[bin] = m_syst[bin] / sigma;
+          break;
+        }
+
+        case SIGNIFICANCE: {
+          if (m[bin] < 0)
+            break;
+
+          double q = (d[bin] > 0) ? d[bin] * std::log(d[bin] / m[bin]) - (d[bin] - m[bin]) : m[bin];
+          r[bin] = std::copysign(std::sqrt(2 * std::max(q, 0.)), d[bin] - m[bin]);
+          break;
+        }
+      }
+    }
+
+    for (size_t bin = 0; bin < n_cells; bin++) {
+      ratio->SetBinContent(bin, r[bin]);
+      ratio->SetBinError(bin, r_err[bin]);
+      systematics->SetBinContent(bin, band[bin]);
+      systematics->SetBinError(bin, band_err[bin]);
+    }
   }
 }
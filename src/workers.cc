@@ -0,0 +1,313 @@
+#include "plotIt.h"
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <InputStore.h>
+#include <Progress.h>
+#include <logging.h>
+
+/**
+ * Worker pool. The parent process loads every object needed by the expanded
+ * plots once, then forks workers. Each worker inherits the loaded objects
+ * through copy-on-write pages, draws a disjoint subset of the plots, and
+ * sends its logs and results back to the parent through a pipe.
+ **/
+
+namespace plotIt {
+
+  // Messages sent by workers to the parent: one type byte, a 32 bits length and the payload
+  enum MessageType: char {
+    LOG_TEXT = 'L',
+    LOG_ERRORS = 'E',
+    LOG_JSON = 'J',
+    OUTPUT_CHANGED = 'C',
+    OUTPUT_UNCHANGED = 'U',
+    PLOT_RESULT = 'R',
+    PLOT_DONE = 'D'     // Success, bytes read since the fork and resident memory
+  };
+
+  static bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+      ssize_t written = write(fd, data, length);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+
+      data += written;
+      length -= written;
+    }
+
+    return true;
+  }
+
+  static void sendMessage(int fd, MessageType type, const std::string& payload) {
+    char header[5];
+    uint32_t length = payload.length();
+    header[0] = type;
+    memcpy(header + 1, &length, sizeof(length));
+
+    writeAll(fd, header, sizeof(header));
+    writeAll(fd, payload.data(), payload.length());
+  }
+
+  struct WorkerChannel {
+    pid_t pid;
+    int fd;
+    std::string buffer;
+
+    // Number of plots reported as done. Workers draw their plots in order
+    size_t done;
+
+    // Results of the plot being drawn, only kept once it's reported as done
+    std::vector<PlotResult> results;
+  };
+
+  void plotIt::preloadObjects(const std::vector<Plot>& plots) {
+    LOG(INFO) << "Loading " << plots.size() << " object(s) from " << m_files.size() << " file(s)";
+
+    createInputStore();
+
+    // Every (file, object) pair is requested, so that workers never need to
+    // read from the file handles they inherit
+    for (File& file: m_files) {
+      for (const Plot& plot: plots) {
+        m_inputs->getObject(getInputPath(file.path), plot.name);
+
+        for (Systematic& syst: file.systematics) {
+          m_inputs->getObject(getInputPath(syst.path), syst.getObjectName(plot.name));
+        }
+      }
+    }
+  }
+
+  /**
+   * Draw 'plots' using m_config.workers worker processes.
+   * Return the number of plots which failed.
+   **/
+  uint32_t plotIt::plotInWorkers(std::vector<Plot>& plots) {
+    uint16_t n_workers = std::min<size_t>(m_config.workers, plots.size());
+
+    // Nothing buffered must be inherited by the workers, or it would be written twice
+    Logger::get().flush();
+
+    std::vector<WorkerChannel> workers;
+    for (uint16_t worker = 0; worker < n_workers; worker++) {
+      int fds[2];
+      if (pipe(fds) != 0) {
+        LOG(ERROR) << "cannot create pipe for worker " << worker << ": " << strerror(errno);
+        break;
+      }
+
+      pid_t pid = fork();
+      if (pid < 0) {
+        LOG(ERROR) << "cannot fork worker " << worker << ": " << strerror(errno);
+        close(fds[0]);
+        close(fds[1]);
+        break;
+      }
+
+      if (pid == 0) {
+        // Worker
+        m_workerIndex = worker;
+        close(fds[0]);
+        for (WorkerChannel& other: workers)
+          close(other.fd);
+
+        int fd = fds[1];
+        Logger::get().forward([fd](const std::string& text, const std::string& errors, const std::string& json) {
+            if (text.length())
+              sendMessage(fd, LOG_TEXT, text);
+            if (errors.length())
+              sendMessage(fd, LOG_ERRORS, errors);
+            if (json.length())
+              sendMessage(fd, LOG_JSON, json);
+          });
+
+        // The progress belongs to the parent, and is only started once all workers are forked
+        uint64_t bytes_at_fork = Progress::getBytesRead();
+
+        size_t sent_outputs = 0;
+        size_t sent_results = 0;
+        for (size_t i = worker; i < plots.size(); i += n_workers) {
+          bool success = plot(plots[i]);
+          if (! success) {
+            PlotResult result;
+            result.name = plots[i].name;
+            m_results.push_back(result);
+          }
+
+          // Sent after each plot, so that the parent knows which plots are done if this worker crashes.
+          // A plot is only counted, as done or failed, with PLOT_DONE
+          for (; sent_outputs < m_changedOutputs.size(); sent_outputs++)
+            sendMessage(fd, OUTPUT_CHANGED, m_changedOutputs[sent_outputs].string());
+          for (; sent_results < m_results.size(); sent_results++)
+            sendMessage(fd, PLOT_RESULT, YAML::Dump(YAML::Node(m_results[sent_results])));
+
+          std::ostringstream counters;
+          counters << success << ' ' << Progress::getBytesRead() - bytes_at_fork << ' ' << Progress::getRSS();
+          sendMessage(fd, PLOT_DONE, counters.str());
+        }
+
+        closeExportFile();
+        Logger::get().flush();
+
+        sendMessage(fd, OUTPUT_UNCHANGED, std::to_string(m_unchangedOutputs));
+
+        close(fd);
+
+        // Skip static destructors, they belong to the parent
+        _exit(0);
+      }
+
+      close(fds[1]);
+      workers.push_back({pid, fds[0], "", 0});
+    }
+
+    // No more fork from here: the progress thread can run
+    startProgress(plots.size());
+
+    uint32_t failed = 0;
+    if (workers.size() != n_workers) {
+      // Forking failed: let the workers already started finish, and draw the remaining plots here
+      for (size_t worker = workers.size(); worker < n_workers; worker++) {
+        for (size_t i = worker; i < plots.size(); i += n_workers) {
+          reportPlotStarted(plots[i].name);
+
+          bool success = plot(plots[i]);
+          if (! success) {
+            failed++;
+
+            PlotResult result;
+            result.name = plots[i].name;
+            m_results.push_back(result);
+          }
+
+          reportPlotDone(success);
+        }
+      }
+    }
+
+    std::vector<pollfd> fds;
+    for (WorkerChannel& worker: workers)
+      fds.push_back({worker.fd, POLLIN, 0});
+
+    size_t running = workers.size();
+    char buffer[64 * 1024];
+    while (running > 0) {
+      if (poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+
+      for (size_t i = 0; i < fds.size(); i++) {
+        if (fds[i].fd < 0 || ! (fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+          continue;
+
+        WorkerChannel& worker = workers[i];
+        ssize_t length = read(worker.fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR)
+          continue;
+
+        if (length <= 0) {
+          close(worker.fd);
+          fds[i].fd = -1;
+          running--;
+          continue;
+        }
+
+        worker.buffer.append(buffer, length);
+
+        // Decode all complete messages
+        size_t offset = 0;
+        while (worker.buffer.length() - offset >= 5) {
+          uint32_t payload_length;
+          memcpy(&payload_length, worker.buffer.data() + offset + 1, sizeof(payload_length));
+          if (worker.buffer.length() - offset - 5 < payload_length)
+            break;
+
+          MessageType type = static_cast<MessageType>(worker.buffer[offset]);
+          std::string payload = worker.buffer.substr(offset + 5, payload_length);
+          offset += 5 + payload_length;
+
+          switch (type) {
+            case LOG_TEXT:
+              Logger::get().append(payload, "", "");
+              break;
+            case LOG_ERRORS:
+              Logger::get().append("", payload, "");
+              break;
+            case LOG_JSON:
+              Logger::get().append("", "", payload);
+              break;
+            case OUTPUT_CHANGED:
+              m_changedOutputs.push_back(payload);
+              break;
+            case OUTPUT_UNCHANGED:
+              m_unchangedOutputs += std::stoul(payload);
+              break;
+            case PLOT_RESULT:
+              worker.results.push_back(YAML::Load(payload).as<PlotResult>());
+              break;
+            case PLOT_DONE: {
+              bool success = false;
+              uint64_t bytes_read = 0, rss = 0;
+              std::istringstream counters(payload);
+              counters >> success >> bytes_read >> rss;
+
+              worker.done++;
+              if (! success)
+                failed++;
+
+              m_results.insert(m_results.end(), worker.results.begin(), worker.results.end());
+              worker.results.clear();
+
+              if (m_progress.get()) {
+                m_progress->setWorker(i, bytes_read, rss);
+                m_progress->plotDone(success);
+              }
+              break;
+            }
+          }
+        }
+
+        worker.buffer.erase(0, offset);
+      }
+    }
+
+    for (size_t w = 0; w < workers.size(); w++) {
+      WorkerChannel& worker = workers[w];
+      int status = 0;
+      waitpid(worker.pid, &status, 0);
+
+      // The plots the worker did not report as done are failed. Results
+      // received for the plot it was drawing are dropped, it gets only this one
+      size_t missing = 0;
+      for (size_t i = w + worker.done * n_workers; i < plots.size(); i += n_workers) {
+        PlotResult result;
+        result.name = plots[i].name;
+        m_results.push_back(result);
+
+        if (m_progress.get())
+          m_progress->plotDone(false);
+
+        missing++;
+      }
+      failed += missing;
+
+      if (! WIFEXITED(status) || WEXITSTATUS(status) != 0 || missing) {
+        LOG(ERROR) << "worker process " << worker.pid << " did not exit cleanly, " << missing << " of its plot(s) failed";
+      }
+    }
+
+    return failed;
+  }
+}